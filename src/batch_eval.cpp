@@ -0,0 +1,110 @@
+#include "batch_eval.hpp"
+
+#include <algorithm>
+
+#include "evaluator.hpp"
+#include "position.hpp"
+
+namespace chess {
+
+PackedPosition PackPosition(const Position& pos) {
+  PackedPosition packed;
+  std::copy(pos.state_.piece_bitboards,
+            pos.state_.piece_bitboards + kPieceCount, packed.piece_bitboards);
+  packed.side_to_move = pos.state_.side_to_move;
+  return packed;
+}
+
+// Expands a packed position into the parts of a position state that the
+// evaluation reads and evaluates it.
+// @param packed The packed position.
+// @return The evaluation score from the side to move's point of view.
+static int EvaluatePacked(const PackedPosition& packed) {
+  PositionState state{};
+  state.side_to_move = packed.side_to_move;
+  for (int p = kWhitePawn; p <= kBlackKing; p++) {
+    Piece piece = static_cast<Piece>(p);
+    Color color = GetPieceColor(piece);
+    int sign = color == kWhite ? 1 : -1;
+    Bitboard current_pieces = packed.piece_bitboards[piece];
+    state.piece_bitboards[piece] = current_pieces;
+    state.piece_occupancy[color] |= current_pieces;
+    state.game_phase += CountBits(current_pieces) * kGamePhaseInc[piece];
+    while (current_pieces) {
+      Square square = static_cast<Square>(GetLSBIndex(current_pieces));
+      ClearLSB(current_pieces);
+      state.psq_score += sign * kPieceSquareTables[piece][square];
+    }
+  }
+  state.piece_occupancy[kBothColors] =
+      state.piece_occupancy[kWhite] | state.piece_occupancy[kBlack];
+  return Evaluate(state);
+}
+
+BatchEvaluator::BatchEvaluator(int threads) {
+  for (int i = 1; i < threads; i++) {
+    workers_.emplace_back(&BatchEvaluator::WorkerLoop, this);
+  }
+}
+
+BatchEvaluator::~BatchEvaluator() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  start_condition_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+}
+
+void BatchEvaluator::Evaluate(const PackedPosition* positions, int count,
+                              int* scores) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    positions_ = positions;
+    scores_ = scores;
+    count_ = count;
+    num_chunks_ = (count + kBatchChunkSize - 1) / kBatchChunkSize;
+    next_chunk_ = 0;
+    busy_workers_ = workers_.size();
+    batch_number_++;
+  }
+  start_condition_.notify_all();
+
+  EvaluateChunks();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_condition_.wait(lock, [this] { return busy_workers_ == 0; });
+}
+
+void BatchEvaluator::WorkerLoop() {
+  uint64_t last_batch = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_condition_.wait(
+          lock, [&] { return quit_ || batch_number_ != last_batch; });
+      if (quit_) return;
+      last_batch = batch_number_;
+    }
+
+    EvaluateChunks();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--busy_workers_ == 0) done_condition_.notify_one();
+  }
+}
+
+void BatchEvaluator::EvaluateChunks() {
+  // Every thread takes the next chunk until none are left, so slower chunks
+  // do not hold up the others
+  int chunk;
+  while ((chunk = next_chunk_.fetch_add(1)) < num_chunks_) {
+    int start = chunk * kBatchChunkSize;
+    int end = std::min(start + kBatchChunkSize, count_);
+    for (int i = start; i < end; i++) {
+      scores_[i] = EvaluatePacked(positions_[i]);
+    }
+  }
+}
+
+}  // namespace chess
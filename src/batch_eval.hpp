@@ -0,0 +1,92 @@
+#pragma once
+#ifndef BATCH_EVAL_HPP
+#define BATCH_EVAL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace chess {
+
+class Position;  // Forward declaration.
+
+// The number of positions a worker takes from a batch at a time.
+inline constexpr int kBatchChunkSize = 256;
+
+// A position reduced to what the evaluation reads: the pieces and the side to
+// move. Castling rights, the en passant square and the move counters do not
+// change the evaluation and are dropped.
+struct PackedPosition {
+  Bitboard piece_bitboards[kPieceCount];
+  Color side_to_move;
+};
+
+// Packs the given position.
+// @param pos The position.
+// @return The packed position.
+PackedPosition PackPosition(const Position& pos);
+
+// Evaluates batches of packed positions with a pool of threads that is
+// started once and reused for every batch, so small batches do not pay for
+// starting threads.
+class BatchEvaluator {
+ public:
+  // Starts the worker threads. The thread calling Evaluate also evaluates, so
+  // one less worker than the given number of threads is started.
+  // @param threads The number of threads to evaluate with.
+  explicit BatchEvaluator(int threads);
+
+  // Stops and joins the worker threads.
+  ~BatchEvaluator();
+
+  BatchEvaluator(const BatchEvaluator&) = delete;
+  BatchEvaluator& operator=(const BatchEvaluator&) = delete;
+
+  // Evaluates every position of the given array into the array of scores,
+  // from the side to move's point of view like Evaluate. No hash tables are
+  // used, so the scores are the same as Evaluate on a fresh position.
+  // @param positions The positions.
+  // @param count The number of positions.
+  // @param scores The array to store the score of each position in.
+  void Evaluate(const PackedPosition* positions, int count, int* scores);
+
+  // Returns the number of threads that evaluate a batch.
+  // @return The number of threads.
+  inline int GetThreadCount() const;
+
+ private:
+  // Waits for batches and evaluates chunks of them until stopped.
+  void WorkerLoop();
+
+  // Evaluates chunks of the current batch until none are left.
+  void EvaluateChunks();
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_condition_;
+  std::condition_variable done_condition_;
+  bool quit_ = false;
+
+  // Incremented for every batch so the workers can tell a new batch apart.
+  uint64_t batch_number_ = 0;
+  int busy_workers_ = 0;
+
+  // The current batch.
+  const PackedPosition* positions_ = nullptr;
+  int* scores_ = nullptr;
+  int count_ = 0;
+  int num_chunks_ = 0;
+  std::atomic<int> next_chunk_ = 0;
+};
+
+inline int BatchEvaluator::GetThreadCount() const {
+  return static_cast<int>(workers_.size()) + 1;
+}
+
+}  // namespace chess
+
+#endif  // BATCH_EVAL_HPP
@@ -0,0 +1,52 @@
+#include "endgame.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "evaluator.hpp"
+#include "position.hpp"
+#include "utils.hpp"
+
+namespace chess {
+
+// Returns a bonus that grows as the square gets closer to the edge of the
+// board.
+// @param square The square.
+// @return The bonus.
+static int PushToEdge(Square square) {
+  int file = GetFile(square);
+  int rank = GetRank(square);
+  int center_distance = std::max(3 - file, file - 4) +
+                        std::max(3 - rank, rank - 4);
+  return 20 * center_distance;
+}
+
+// Returns a bonus that grows as the two squares get closer to each other.
+// @param square1 The first square.
+// @param square2 The second square.
+// @return The bonus.
+static int PushClose(Square square1, Square square2) {
+  int distance = std::max(std::abs(GetFile(square1) - GetFile(square2)),
+                          std::abs(GetRank(square1) - GetRank(square2)));
+  return 140 - 20 * distance;
+}
+
+int EvaluateDraw(const PositionState&, Color) { return kDrawScore; }
+
+int EvaluateKXK(const PositionState& state, Color strong_side) {
+  Square strong_king = static_cast<Square>(
+      GetLSBIndex(state.piece_bitboards[GetPiece(kKing, strong_side)]));
+  Square weak_king = static_cast<Square>(
+      GetLSBIndex(state.piece_bitboards[GetPiece(kKing, ~strong_side)]));
+
+  int score = kKnownWinScore;
+  for (int pt = kPawn; pt < kKing; pt++) {
+    Piece piece = GetPiece(static_cast<PieceType>(pt), strong_side);
+    score += kEgPieceValues[pt] * CountBits(state.piece_bitboards[piece]);
+  }
+  score += PushToEdge(weak_king) + PushClose(strong_king, weak_king);
+
+  return strong_side == state.side_to_move ? score : -score;
+}
+
+}  // namespace chess
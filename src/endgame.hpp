@@ -0,0 +1,38 @@
+#pragma once
+#ifndef ENDGAME_HPP
+#define ENDGAME_HPP
+
+#include "utils.hpp"
+
+namespace chess {
+
+struct PositionState;  // Forward declaration.
+
+// The score added to the evaluation of an endgame that is known to be won. It
+// is far above any normal evaluation but well below the mate scores.
+constexpr int kKnownWinScore = 10000;
+
+// An evaluation function for a recognized material signature.
+// @param state The position.
+// @param strong_side The side with the winning material, if there is one.
+// @return The evaluation score from the side to move's point of view.
+using EndgameFunction = int (*)(const PositionState& state, Color strong_side);
+
+// Evaluates an endgame where neither side can force mate, such as KNK, KBK
+// and KNNK.
+// @param state The position.
+// @param strong_side Unused.
+// @return The draw score.
+int EvaluateDraw(const PositionState& state, Color strong_side);
+
+// Evaluates an endgame where the strong side has at least a rook or a queen
+// against a lone king. The weak king is driven to the edge of the board and
+// the strong king towards it.
+// @param state The position.
+// @param strong_side The side with the rook or queen.
+// @return The evaluation score from the side to move's point of view.
+int EvaluateKXK(const PositionState& state, Color strong_side);
+
+}  // namespace chess
+
+#endif  // ENDGAME_HPP
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef EVAL_CACHE_HPP
+#define EVAL_CACHE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace chess {
+
+// Caches the static evaluation of positions by Zobrist key. The same leaves
+// are evaluated again in every iteration and through transpositions, and
+// finding them here is much cheaper than evaluating them.
+//
+// Each entry is a single 64 bit word holding the upper 48 bits of the key and
+// the 16 bit score, so an entry can never be read half written and the table
+// needs no locks. Each search engine owns its own table.
+class EvalCache {
+ public:
+  // The number of probes and hits since the counters were reset.
+  uint64_t probes_ = 0;
+  uint64_t hits_ = 0;
+
+  // Whether the cache is used. Disabled by the bench to measure how much
+  // evaluation time the cache saves.
+  bool enabled_ = true;
+
+  EvalCache() : table_(kEvalCacheSize, 0) {}
+
+  // Looks up the score of the given key.
+  // @param key The Zobrist key of the position.
+  // @param score Set to the cached score if the key is found.
+  // @return Whether the key was found.
+  inline bool Probe(Key key, int &score);
+
+  // Stores the score of the given key, replacing whatever was in its entry.
+  // @param key The Zobrist key of the position.
+  // @param score The static evaluation of the position.
+  inline void Store(Key key, int score);
+
+  // Resets the hit counters.
+  inline void ResetCounters();
+
+  // Clears the table.
+  inline void Clear();
+
+ private:
+  static constexpr uint64_t kKeyMask = ~uint64_t{0xFFFF};
+
+  std::vector<uint64_t> table_;
+};
+
+inline bool EvalCache::Probe(Key key, int &score) {
+  if (!enabled_) return false;
+  probes_++;
+  uint64_t entry = table_[key & (kEvalCacheSize - 1)];
+  if ((entry & kKeyMask) != (key & kKeyMask)) return false;
+  hits_++;
+  score = static_cast<int16_t>(entry & 0xFFFF);
+  return true;
+}
+
+inline void EvalCache::Store(Key key, int score) {
+  if (!enabled_) return;
+  table_[key & (kEvalCacheSize - 1)] =
+      (key & kKeyMask) | static_cast<uint16_t>(score);
+}
+
+inline void EvalCache::ResetCounters() {
+  probes_ = 0;
+  hits_ = 0;
+}
+
+inline void EvalCache::Clear() {
+  std::fill(table_.begin(), table_.end(), 0);
+  ResetCounters();
+}
+
+}  // namespace chess
+
+#endif  // EVAL_CACHE_HPP
@@ -4,133 +4,220 @@
 #include "utils.hpp"
 
 namespace chess {
-int mgEvalTables[12][64];
-int egEvalTables[12][64];
-
-void InitEvalTables() {
-  for (Piece p = kWhitePawn; p <= kBlackKing; p++) {
-    for (Square s = kSquareStart; s < kNumSquares; s++) {
-      Square source_square = s;
-      if (GetPieceColor(p) == kBlack) {
-        source_square = MirrorSquare(s);
+// Evaluates the pawn structure of the position into the given entry.
+// @param state The position.
+// @param entry The entry to fill.
+// @param scores Set to the pawn structure score of each side.
+static void EvaluatePawns(const PositionState& state, PawnEntry& entry,
+                          Score scores[kNumColors]) {
+  entry.key = state.pawn_key;
+
+  // Every term is computed for all pawns of a side at once from the fills of
+  // both sides' pawns
+  for (Color color : {kWhite, kBlack}) {
+    Bitboard pawns = state.piece_bitboards[GetPiece(kPawn, color)];
+    Bitboard enemy_pawns = state.piece_bitboards[GetPiece(kPawn, ~color)];
+    Bitboard files = FileFill(pawns);
+    Bitboard front_span = FrontSpan(pawns, color);
+    Bitboard enemy_front_span = FrontSpan(enemy_pawns, ~color);
+
+    // The eighth rank of the file fill has bit n set for file n
+    entry.pawn_files[color] = static_cast<uint8_t>(files & kRank8Mask);
+    entry.attack_spans[color] = ShiftEast(front_span) | ShiftWest(front_span);
+
+    // Double pawn penalty. Every pawn behind another pawn of its side.
+    Bitboard doubled = pawns & RearSpan(pawns, color);
+
+    // Isolated pawn penalty. Every pawn without pawns of its side on the
+    // adjacent files.
+    Bitboard isolated = pawns & ~(ShiftEast(files) | ShiftWest(files));
+
+    // Passed pawn bonus. Every pawn that no enemy pawn is in front of or can
+    // capture on the way.
+    Bitboard passed = pawns & ~(enemy_front_span | ShiftEast(enemy_front_span) |
+                                ShiftWest(enemy_front_span));
+    entry.passed_pawns[color] = passed;
+
+    scores[color] = CountBits(doubled) * kDoubledPawnPenalty +
+                    CountBits(isolated) * kIsolatedPawnPenalty;
+    while (passed) {
+      Square square = static_cast<Square>(GetLSBIndex(passed));
+      ClearLSB(passed);
+      int passed_ranks = GetRank(square);
+      if (color == kBlack) passed_ranks = 7 - passed_ranks;
+      scores[color] += kPassedPawnBonus[passed_ranks];
+    }
+  }
+
+  entry.score = scores[kWhite] - scores[kBlack];
+}
+
+void EvaluatePawns(const PositionState& state, PawnEntry& entry) {
+  Score scores[kNumColors];
+  EvaluatePawns(state, entry, scores);
+}
+
+void EvaluateMaterial(const PositionState& state, MaterialEntry& entry) {
+  entry.key = state.material_key;
+  entry.endgame_function = nullptr;
+  entry.strong_side = kWhite;
+
+  int pawns[kNumColors];
+  int knights[kNumColors];
+  int bishops[kNumColors];
+  int majors[kNumColors];
+  int non_pawn_material[kNumColors];
+  for (Color color : {kWhite, kBlack}) {
+    auto count = [&state, color](PieceType pt) {
+      return CountBits(state.piece_bitboards[GetPiece(pt, color)]);
+    };
+    pawns[color] = count(kPawn);
+    knights[color] = count(kKnight);
+    bishops[color] = count(kBishop);
+    majors[color] = count(kRook) + count(kQueen);
+    non_pawn_material[color] = knights[color] * kMgPieceValues[kKnight] +
+                               bishops[color] * kMgPieceValues[kBishop] +
+                               count(kRook) * kMgPieceValues[kRook] +
+                               count(kQueen) * kMgPieceValues[kQueen];
+  }
+
+  // Neither side can force mate with at most one minor piece each, or with two
+  // knights against a lone king
+  if (pawns[kWhite] + pawns[kBlack] == 0 &&
+      majors[kWhite] + majors[kBlack] == 0) {
+    int minors[kNumColors] = {knights[kWhite] + bishops[kWhite],
+                              knights[kBlack] + bishops[kBlack]};
+    bool two_knights = (knights[kWhite] == 2 && bishops[kWhite] == 0 &&
+                        minors[kBlack] == 0) ||
+                       (knights[kBlack] == 2 && bishops[kBlack] == 0 &&
+                        minors[kWhite] == 0);
+    if ((minors[kWhite] <= 1 && minors[kBlack] <= 1) || two_knights) {
+      entry.endgame_function = EvaluateDraw;
+      return;
+    }
+  }
+
+  for (Color color : {kWhite, kBlack}) {
+    // A rook or a queen against a lone king is a known win
+    if (majors[color] > 0 && pawns[~color] == 0 &&
+        non_pawn_material[~color] == 0) {
+      entry.endgame_function = EvaluateKXK;
+      entry.strong_side = color;
+      return;
+    }
+
+    // Without pawns, a side that is at most a minor piece ahead can rarely
+    // win, and not at all without at least a rook's worth of material
+    entry.scale_factors[color] = kNormalScaleFactor;
+    if (pawns[color] == 0 &&
+        non_pawn_material[color] - non_pawn_material[~color] <=
+            kMgPieceValues[kBishop]) {
+      if (non_pawn_material[color] < kMgPieceValues[kRook]) {
+        entry.scale_factors[color] = 0;
+      } else if (non_pawn_material[~color] <= kMgPieceValues[kBishop]) {
+        entry.scale_factors[color] = kMinorAheadScaleFactor;
+      } else {
+        entry.scale_factors[color] = kPiecesAheadScaleFactor;
       }
-      PieceType pt = GetPieceType(p);
-      mgEvalTables[p][s] =
-          kMgEvalTables[pt][source_square] + kMgPieceValues[pt];
-      egEvalTables[p][s] =
-          kEgEvalTables[pt][source_square] + kEgPieceValues[pt];
     }
   }
+
+  // Bishop pair bonus.
+  entry.imbalance = kScoreZero;
+  if (bishops[kWhite] >= 2) entry.imbalance += kBishopPairBonus;
+  if (bishops[kBlack] >= 2) entry.imbalance -= kBishopPairBonus;
+}
+
+// Tapers the given scores by the game phase and scales the endgame score by
+// the side that is ahead.
+// @param state The position.
+// @param material The evaluation of the material signature of the position.
+// @param score The score of white minus that of black.
+// @return The evaluation score from the side to move's point of view.
+static int Taper(const PositionState& state, const MaterialEntry& material,
+                 Score score) {
+  int mg_score = MgValue(score);
+  int eg_score = EgValue(score);
+  Color strong_side = eg_score > 0 ? kWhite : kBlack;
+  eg_score =
+      (eg_score * material.scale_factors[strong_side]) / kNormalScaleFactor;
+  int mg_phase = std::min(state.game_phase, 24);
+  int eg_phase = 24 - mg_phase;
+
+  int tapered = ((mg_score * mg_phase) + (eg_score * eg_phase)) / 24;
+
+  // Flip score if black is to move.
+  if (state.side_to_move == kBlack) tapered = -tapered;
+
+  return tapered;
 }
 
-int Evaluate(const Position& pos) {
-  int mg[2] = {0, 0};
-  int eg[2] = {0, 0};
-  int game_phase = 0;
+// Evaluates the mobility, file and king safety terms of the pieces.
+// @param state The position.
+// @param pawns The evaluation of the pawn structure of the position.
+// @param terms The scores of each term and side to add the terms to.
+static void EvaluatePieces(const PositionState& state, const PawnEntry& pawns,
+                           Score terms[kNumEvalTerms][kNumColors]) {
+  uint8_t all_pawn_files = pawns.pawn_files[kWhite] | pawns.pawn_files[kBlack];
 
-  for (Piece p = kWhitePawn; p <= kBlackKing; p++) {
-    Bitboard current_pieces = pos.state_.piece_bitboards[p];
+  for (Piece p = kWhiteKnight; p <= kBlackKing; p++) {
+    PieceType pt = GetPieceType(p);
+    if (pt == kPawn || pt == kKnight) continue;
+    Color color = GetPieceColor(p);
+
+    Bitboard current_pieces = state.piece_bitboards[p];
     while (current_pieces) {
       Square square = static_cast<Square>(GetLSBIndex(current_pieces));
       ClearLSB(current_pieces);
-      Color color = GetPieceColor(p);
-      PieceType pt = GetPieceType(p);
-      mg[color] += mgEvalTables[p][square];
-      eg[color] += egEvalTables[p][square];
-      game_phase += kGamePhaseInc[p];
-
-      int double_pawns;
-      Piece enemy_pawn;
+      int file_bit = 1 << GetFile(square);
+
       int bishop_moves;
-      Bitboard friendly_pawns;
       int queen_moves;
       int king_shields;
 
       switch (pt) {
-        case kPawn:
-          // Double pawn penalty.
-          double_pawns =
-              CountBits(current_pieces & kFileMasks[GetFile(square)]);
-          if (double_pawns > 1) {
-            mg[color] += kDoubledPawnPenalty;
-            eg[color] += kDoubledPawnPenalty;
-          }
-
-          // Isolated pawn penalty.
-          if (!(current_pieces &
-                precomputed_data::isolated_pawn_masks[square])) {
-            mg[color] += kIsolatedPawnPenalty;
-            eg[color] += kIsolatedPawnPenalty;
-          }
-
-          // Passed pawn bonus.
-          enemy_pawn = GetPiece(kPawn, ~color);
-          if (!(precomputed_data::passed_pawn_masks[square][color] &
-                pos.state_.piece_bitboards[enemy_pawn])) {
-            int passed_ranks = GetRank(square);
-            if (color == kBlack) passed_ranks = 7 - passed_ranks;
-            mg[color] += kPassedPawnBonus[passed_ranks];
-            eg[color] += kPassedPawnBonus[passed_ranks];
-          }
-          break;
-        case kKnight:
-          break;
         case kBishop:
           // Bishop mobility bonus.
           bishop_moves =
-          CountBits(precomputed_data::GetBishopAttacks(
-                        square, pos.state_.piece_occupancy[kBothColors]) &
-                    ~pos.state_.piece_occupancy[color]);
-          mg[color] += bishop_moves * kBishopMobilityBonus;
-          eg[color] += bishop_moves * kBishopMobilityBonus;
+              CountBits(precomputed_data::GetBishopAttacks(
+                            square, state.piece_occupancy[kBothColors]) &
+                        ~state.piece_occupancy[color]);
+          terms[kMobilityTerm][color] += bishop_moves * kBishopMobilityBonus;
           break;
         case kRook:
           // Rook semi open file bonus.
-          friendly_pawns = pos.state_.piece_bitboards[GetPiece(kPawn, color)];
-          if (!(friendly_pawns & kFileMasks[GetFile(square)])) {
-            mg[color] += kRookSemiOpenFileBonus;
-            eg[color] += kRookSemiOpenFileBonus;
+          if (!(pawns.pawn_files[color] & file_bit)) {
+            terms[kRookFilesTerm][color] += kRookSemiOpenFileBonus;
           }
 
           // Rook open file bonus.
-          if (!((pos.state_.piece_bitboards[kWhitePawn] |
-                 pos.state_.piece_bitboards[kBlackPawn]) &
-                kFileMasks[GetFile(square)])) {
-            mg[color] += kRookOpenFileBonus;
-            eg[color] += kRookOpenFileBonus;
+          if (!(all_pawn_files & file_bit)) {
+            terms[kRookFilesTerm][color] += kRookOpenFileBonus;
           }
           break;
         case kQueen:
           // Queen mobility bonus.
           queen_moves =
               CountBits(precomputed_data::GetQueenAttacks(
-                            square, pos.state_.piece_occupancy[kBothColors])
-                            &
-                        ~pos.state_.piece_occupancy[color]);
-          mg[color] += queen_moves * kQueenMobilityBonus;
-          eg[color] += queen_moves * kQueenMobilityBonus;
+                            square, state.piece_occupancy[kBothColors]) &
+                        ~state.piece_occupancy[color]);
+          terms[kMobilityTerm][color] += queen_moves * kQueenMobilityBonus;
           break;
         case kKing:
           // King semi open file penalty.
-          friendly_pawns = pos.state_.piece_bitboards[GetPiece(kPawn, color)];
-          if (!(friendly_pawns & kFileMasks[GetFile(square)])) {
-            mg[color] += kKingSemiOpenFilePenalty;
-            eg[color] += kKingSemiOpenFilePenalty;
+          if (!(pawns.pawn_files[color] & file_bit)) {
+            terms[kKingSafetyTerm][color] += kKingSemiOpenFilePenalty;
           }
 
           // King open file penalty.
-          if (!((pos.state_.piece_bitboards[kWhitePawn] |
-                 pos.state_.piece_bitboards[kBlackPawn]) &
-                kFileMasks[GetFile(square)])) {
-            mg[color] += kKingOpenFilePenalty;
-            eg[color] += kKingOpenFilePenalty;
+          if (!(all_pawn_files & file_bit)) {
+            terms[kKingSafetyTerm][color] += kKingOpenFilePenalty;
           }
 
           // King shield bonus.
           king_shields = CountBits(precomputed_data::king_attacks[square] &
-                                   pos.state_.piece_occupancy[color]);
-          mg[color] += king_shields * kKingShieldBonus;
-          eg[color] += king_shields * kKingShieldBonus;
+                                   state.piece_occupancy[color]);
+          terms[kKingSafetyTerm][color] += king_shields * kKingShieldBonus;
           break;
 
         default:
@@ -138,29 +225,134 @@ int Evaluate(const Position& pos) {
       }
     }
   }
+}
 
-  // Bishop pair bonus.
-  if (CountBits(pos.state_.piece_bitboards[kWhiteBishop]) >= 2) {
-    mg[kWhite] += kBishopPairBonus;
-    eg[kWhite] += kBishopPairBonus;
+// Evaluates the position with the given material and pawn structure
+// evaluations. The material and piece-square scores are kept up to date by
+// MakeMove, so they give a cheap estimate of the score. If the estimate is so
+// far outside the window that the piece terms cannot bring it back, it is
+// returned without evaluating the pieces.
+// @param state The position.
+// @param material The evaluation of the material signature of the position.
+// @param pawns The evaluation of the pawn structure of the position.
+// @param alpha The lower bound of the window.
+// @param beta The upper bound of the window.
+// @param lazy Set to whether the estimate was returned.
+// @return The evaluation score from the side to move's point of view.
+static int Evaluate(const PositionState& state, const MaterialEntry& material,
+                    const PawnEntry& pawns, int alpha, int beta,
+                    bool& lazy) {
+  Score score = state.psq_score + material.imbalance + pawns.score;
+
+  int estimate = Taper(state, material, score);
+  lazy = estimate + kLazyEvalMargin <= alpha ||
+         estimate - kLazyEvalMargin >= beta;
+  if (lazy) return estimate;
+
+  Score terms[kNumEvalTerms][kNumColors] = {};
+  EvaluatePieces(state, pawns, terms);
+  for (int term = kMobilityTerm; term <= kKingSafetyTerm; term++) {
+    score += terms[term][kWhite] - terms[term][kBlack];
   }
-  if (CountBits(pos.state_.piece_bitboards[kBlackBishop]) >= 2) {
-    mg[kBlack] += kBishopPairBonus;
-    eg[kBlack] += kBishopPairBonus;
+  return Taper(state, material, score);
+}
+
+int Evaluate(const PositionState& state) {
+  MaterialEntry material;
+  EvaluateMaterial(state, material);
+  if (material.endgame_function != nullptr) {
+    return material.endgame_function(state, material.strong_side);
   }
 
-  // Tapered eval.
-  int mg_score = mg[kWhite] - mg[kBlack];
-  int eg_score = eg[kWhite] - eg[kBlack];
-  int mg_phase = std::min(game_phase, 24);
-  int eg_phase = 24 - mg_phase;
+  PawnEntry pawns;
+  EvaluatePawns(state, pawns);
+  bool lazy;
+  return Evaluate(state, material, pawns, -kInfinity, kInfinity, lazy);
+}
 
-  int score = ((mg_score * mg_phase) + (eg_score * eg_phase)) / 24;
+// Evaluates the position with the given tables.
+// @param state The position.
+// @param tables The evaluation hash tables.
+// @param alpha The lower bound of the window.
+// @param beta The upper bound of the window.
+// @return The evaluation score, or an estimate outside the window.
+static int Evaluate(const PositionState& state, EvalTables& tables, int alpha,
+                    int beta) {
+  int score;
+  if (tables.eval_cache.Probe(state.key, score)) return score;
 
-  // Flip score if black is to move.
-  if (pos.state_.side_to_move == kBlack) score = -score;
+  MaterialEntry& material = tables.material_table.Probe(state.material_key);
+  if (material.key != state.material_key) EvaluateMaterial(state, material);
+  if (material.endgame_function != nullptr) {
+    score = material.endgame_function(state, material.strong_side);
+  } else {
+    PawnEntry& pawns = tables.pawn_table.Probe(state.pawn_key);
+    if (pawns.key != state.pawn_key) EvaluatePawns(state, pawns);
+    bool lazy;
+    score = Evaluate(state, material, pawns, alpha, beta, lazy);
 
+    // An estimate is only good for this window, so it is not cached
+    if (lazy) {
+      if constexpr (kCollectSearchStats) tables.lazy_evals++;
+      return score;
+    }
+  }
+
+  tables.eval_cache.Store(state.key, score);
   return score;
 }
 
+int Evaluate(const Position& pos) { return Evaluate(pos.state_); }
+
+int Evaluate(const Position& pos, EvalTables& tables) {
+  return Evaluate(pos.state_, tables, -kInfinity, kInfinity);
+}
+
+int Evaluate(const Position& pos, EvalTables& tables, int alpha, int beta) {
+  return Evaluate(pos.state_, tables, alpha, beta);
+}
+
+void TraceEvaluation(const Position& pos, EvalTrace& trace) {
+  const PositionState& state = pos.state_;
+  trace = EvalTrace();
+
+  MaterialEntry material;
+  EvaluateMaterial(state, material);
+  trace.known_endgame = material.endgame_function != nullptr;
+  trace.game_phase = std::min(state.game_phase, 24);
+  trace.scale_factors[kWhite] = material.scale_factors[kWhite];
+  trace.scale_factors[kBlack] = material.scale_factors[kBlack];
+
+  int score = Evaluate(state);
+  trace.score = state.side_to_move == kWhite ? score : -score;
+
+  // The incremental piece-square score includes the material, so the two are
+  // split again here
+  for (int p = kWhitePawn; p <= kBlackKing; p++) {
+    Piece piece = static_cast<Piece>(p);
+    PieceType pt = GetPieceType(piece);
+    Color color = GetPieceColor(piece);
+    Score value = MakeScore(kMgPieceValues[pt], kEgPieceValues[pt]);
+
+    Bitboard current_pieces = state.piece_bitboards[piece];
+    while (current_pieces) {
+      Square square = static_cast<Square>(GetLSBIndex(current_pieces));
+      ClearLSB(current_pieces);
+      trace.terms[kMaterialTerm][color] += value;
+      trace.terms[kPieceSquareTerm][color] +=
+          kPieceSquareTables[piece][square] - value;
+    }
+  }
+
+  for (Color color : {kWhite, kBlack}) {
+    if (CountBits(state.piece_bitboards[GetPiece(kBishop, color)]) >= 2) {
+      trace.terms[kBishopPairTerm][color] = kBishopPairBonus;
+    }
+  }
+
+  PawnEntry pawns;
+  EvaluatePawns(state, pawns, trace.terms[kPawnsTerm]);
+  EvaluatePieces(state, pawns, trace.terms);
+}
+
 }  // namespace chess
\ No newline at end of file
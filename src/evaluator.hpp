@@ -2,20 +2,38 @@
 #ifndef EVALUATOR_HPP
 #define EVALUATOR_HPP
 
+#include <array>
+
+#include "eval_cache.hpp"
+#include "material_hash_table.hpp"
+#include "pawn_hash_table.hpp"
 #include "utils.hpp"
 
 namespace chess {
-constexpr int kDoubledPawnPenalty = -10;
-constexpr int kIsolatedPawnPenalty = -20;
-constexpr int kPassedPawnBonus[8] = {0, 10, 30, 50, 75, 100, 150, 200};
-constexpr int kRookSemiOpenFileBonus = 10;
-constexpr int kRookOpenFileBonus = 15;
-constexpr int kBishopMobilityBonus = 1;
-constexpr int kBishopPairBonus = 50;
-constexpr int kQueenMobilityBonus = 1;
-constexpr int kKingSemiOpenFilePenalty = -10;
-constexpr int kKingOpenFilePenalty = -15;
-constexpr int kKingShieldBonus = 5;
+constexpr Score kDoubledPawnPenalty = MakeScore(-10, -10);
+constexpr Score kIsolatedPawnPenalty = MakeScore(-20, -20);
+constexpr Score kPassedPawnBonus[8] = {
+    MakeScore(0, 0),     MakeScore(10, 10),   MakeScore(30, 30),
+    MakeScore(50, 50),   MakeScore(75, 75),   MakeScore(100, 100),
+    MakeScore(150, 150), MakeScore(200, 200)};
+constexpr Score kRookSemiOpenFileBonus = MakeScore(10, 10);
+constexpr Score kRookOpenFileBonus = MakeScore(15, 15);
+constexpr Score kBishopMobilityBonus = MakeScore(1, 1);
+constexpr Score kBishopPairBonus = MakeScore(50, 50);
+constexpr Score kQueenMobilityBonus = MakeScore(1, 1);
+constexpr Score kKingSemiOpenFilePenalty = MakeScore(-10, -10);
+constexpr Score kKingOpenFilePenalty = MakeScore(-15, -15);
+constexpr Score kKingShieldBonus = MakeScore(5, 5);
+
+// The largest amount the mobility, file and king terms are assumed to change
+// the material, piece-square and pawn score by. A lazy evaluation returns the
+// cheaper score when it is outside the window by at least this much.
+constexpr int kLazyEvalMargin = 200;
+
+// The endgame scale factors of a side without pawns that is ahead by at most a
+// minor piece, against a minor piece and against more than a minor piece.
+constexpr int kMinorAheadScaleFactor = 4;
+constexpr int kPiecesAheadScaleFactor = 14;
 
 constexpr int kMgPieceValues[6] = {82, 337, 365, 477, 1025, 0};
 constexpr int kEgPieceValues[6] = {94, 281, 297, 512, 936, 0};
@@ -164,9 +182,6 @@ constexpr const int* const kEgEvalTables[6] = {kEgPawnTable,   kEgKnightTable,
 
 constexpr int kGamePhaseInc[12] = {0, 1, 1, 2, 4, 0, 0, 1, 1, 2, 4, 0};
 
-extern int mgEvalTables[12][64];
-extern int egEvalTables[12][64];
-
 // Gets the mirrored square index.
 // @param square The square.
 // @return The mirrored square index.
@@ -174,17 +189,133 @@ constexpr inline Square MirrorSquare(Square square) {
   return static_cast<Square>(square ^ 56);
 }
 
-// Initializes the evaluation tables.
-void InitEvalTables();
+using PieceSquareTables =
+    std::array<std::array<Score, kNumSquares>, kPieceCount>;
+
+// Builds the material plus piece-square score of every piece on every square.
+// The tables above are from white's point of view, so black pieces use the
+// mirrored square.
+// @return The piece-square tables.
+constexpr PieceSquareTables GeneratePieceSquareTables() {
+  PieceSquareTables tables{};
+  for (int p = kWhitePawn; p <= kBlackKing; p++) {
+    Piece piece = static_cast<Piece>(p);
+    PieceType pt = GetPieceType(piece);
+    for (int s = kSquareStart; s < kNumSquares; s++) {
+      Square square = static_cast<Square>(s);
+      if (GetPieceColor(piece) == kBlack) square = MirrorSquare(square);
+      tables[p][s] = MakeScore(kMgEvalTables[pt][square] + kMgPieceValues[pt],
+                               kEgEvalTables[pt][square] + kEgPieceValues[pt]);
+    }
+  }
+  return tables;
+}
+
+// The material plus piece-square score of each piece on each square, from the
+// point of view of the piece's side. Generated at compile time.
+inline constexpr PieceSquareTables kPieceSquareTables =
+    GeneratePieceSquareTables();
 
 class Position;  // Forward declaration.
+struct PositionState;  // Forward declaration.
+
+// The terms of the evaluation, in the order the trace lists them.
+enum EvalTerm : int {
+  kMaterialTerm,
+  kPieceSquareTerm,
+  kPawnsTerm,
+  kBishopPairTerm,
+  kMobilityTerm,
+  kRookFilesTerm,
+  kKingSafetyTerm,
+  kNumEvalTerms,
+};
+
+constexpr const char* kEvalTermNames[kNumEvalTerms] = {
+    "Material", "PST",        "Pawns",      "Bishop pair",
+    "Mobility", "Rook files", "King safety"};
+
+// The number of evaluations the eval trace command times by default.
+constexpr int kDefaultEvalTraceRepetitions = 1000000;
+
+// The evaluation of a position broken down by term and side.
+struct EvalTrace {
+  // The score of each term for each side, from that side's point of view.
+  Score terms[kNumEvalTerms][kNumColors] = {};
+
+  // The game phase, from 0 in the endgame to 24 in the opening.
+  int game_phase = 0;
+
+  // The endgame scale factor of each side, out of kNormalScaleFactor.
+  int scale_factors[kNumColors] = {kNormalScaleFactor, kNormalScaleFactor};
+
+  // Whether the position is a recognized endgame, which is scored by its
+  // endgame function instead of the terms.
+  bool known_endgame = false;
+
+  // The final evaluation from white's point of view.
+  int score = 0;
+};
+
+// The hash tables used by the evaluation. Each search engine owns its own.
+struct EvalTables {
+  EvalCache eval_cache;
+  PawnHashTable pawn_table;
+  MaterialHashTable material_table;
+
+  // The number of lazy evaluations that returned early, only counted in stats
+  // builds.
+  uint64_t lazy_evals = 0;
+};
+
+// Evaluates the material signature of the position into the given entry.
+// Recognized endgames get an endgame function, the others get their imbalance
+// and scale factors.
+// @param state The position.
+// @param entry The entry to fill.
+void EvaluateMaterial(const PositionState& state, MaterialEntry& entry);
+
+// Evaluates the pawn structure of the position into the given entry.
+// @param state The position.
+// @param entry The entry to fill.
+void EvaluatePawns(const PositionState& state, PawnEntry& entry);
 
 // Evaluates the position.
-// Positive values are good for white, negative values are good for black.
+// Positive values are good for the side to move.
 // @param pos The position.
 // @return The evaluation score.
 int Evaluate(const Position& pos);
 
+// Evaluates the given position state. Only the pieces, the side to move, the
+// occupancies and the incremental eval scores of the state are used.
+// @param state The position.
+// @return The evaluation score.
+int Evaluate(const PositionState& state);
+
+// Evaluates the position, looking up the score, the material signature and the
+// pawn structure in the given tables and storing them there if they are
+// missing.
+// @param pos The position.
+// @param tables The evaluation hash tables.
+// @return The evaluation score.
+int Evaluate(const Position& pos, EvalTables& tables);
+
+// Evaluates the position lazily. If the material, piece-square and pawn score
+// is outside the window by more than kLazyEvalMargin, it is returned as is and
+// the pieces are not evaluated. The result is then only good for deciding
+// that the score is outside the window.
+// @param pos The position.
+// @param tables The evaluation hash tables.
+// @param alpha The lower bound of the window.
+// @param beta The upper bound of the window.
+// @return The evaluation score, or an estimate outside the window.
+int Evaluate(const Position& pos, EvalTables& tables, int alpha, int beta);
+
+// Evaluates the position and breaks the evaluation down by term and side.
+// @param pos The position.
+// @param trace The trace to fill.
+void TraceEvaluation(const Position& pos, EvalTrace& trace);
+
 }  // namespace chess
 
 #endif  // EVALUATOR_HPP
\ No newline at end of file
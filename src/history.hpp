@@ -0,0 +1,92 @@
+#pragma once
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace chess {
+
+// Returns the history bonus for a move that caused a beta cutoff at the given
+// depth. Moves that were searched before it and failed to cut off receive the
+// same amount as a penalty.
+// @param depth The depth of the node.
+// @return The history bonus.
+constexpr inline int HistoryBonus(int depth) {
+  return std::min(16 * depth * depth + 32 * depth, kMaxHistoryBonus);
+}
+
+// Applies a gravity update to a history entry. The closer the entry is to
+// +-kMaxHistory the smaller the change, so entries stay bounded and old
+// information decays as new updates arrive.
+// @param entry The history entry to update.
+// @param bonus The bonus to apply, negative for a penalty.
+template <typename NumericType>
+inline void UpdateHistory(NumericType& entry, int bonus) {
+  entry += bonus - entry * std::abs(bonus) / kMaxHistory;
+}
+
+// A history table indexed by a previous move and the current move. Both moves
+// are identified by the piece that moved and its target square.
+class ContinuationHistory {
+ public:
+  ContinuationHistory() : table_(kTableSize, 0) {}
+
+  // Returns the entry for the given previous move and current move.
+  // @param previous_piece The piece that made the previous move.
+  // @param previous_target The target square of the previous move.
+  // @param piece The piece that makes the current move.
+  // @param target The target square of the current move.
+  // @return The history entry.
+  inline int16_t& Get(Piece previous_piece, Square previous_target,
+                      Piece piece, Square target);
+  inline int16_t Get(Piece previous_piece, Square previous_target,
+                     Piece piece, Square target) const;
+
+  // Clears the table.
+  inline void Clear();
+
+ private:
+  // Returns the index of the entry for the given previous and current move.
+  static inline int Index(Piece previous_piece, Square previous_target,
+                          Piece piece, Square target);
+
+  static constexpr int kTableSize = int(kPieceCount) * int(kNumSquares) *
+                                    int(kPieceCount) * int(kNumSquares);
+
+  // The table is stored on the heap because it is too large for the stack.
+  std::vector<int16_t> table_;
+};
+
+inline int ContinuationHistory::Index(Piece previous_piece,
+                                      Square previous_target, Piece piece,
+                                      Square target) {
+  int index = int(previous_piece) * int(kNumSquares) + int(previous_target);
+  index = (index * int(kPieceCount) + int(piece)) * int(kNumSquares) +
+          int(target);
+  return index;
+}
+
+inline int16_t& ContinuationHistory::Get(Piece previous_piece,
+                                         Square previous_target, Piece piece,
+                                         Square target) {
+  return table_[Index(previous_piece, previous_target, piece, target)];
+}
+
+inline int16_t ContinuationHistory::Get(Piece previous_piece,
+                                        Square previous_target, Piece piece,
+                                        Square target) const {
+  return table_[Index(previous_piece, previous_target, piece, target)];
+}
+
+inline void ContinuationHistory::Clear() {
+  std::fill(table_.begin(), table_.end(), 0);
+}
+
+}  // namespace chess
+
+#endif  // HISTORY_HPP
@@ -7,17 +7,22 @@
 #include "uci.hpp"
 #include "utils.hpp"
 
-#define DEBUG false
-
 using namespace chess;
 
-int main() {
-  if (DEBUG) {
-    // Debug
-  } else {
-    Uci uci;
-    uci.Start();
+int main(int argc, char* argv[]) {
+  Uci uci;
+
+  // Run a single command from the command line, e.g. ./Maello bench 8
+  if (argc > 1) {
+    std::string command = argv[1];
+    for (int i = 2; i < argc; i++) {
+      command += " ";
+      command += argv[i];
+    }
+    uci.ProcessCommand(command);
+    return 0;
   }
 
+  uci.Start();
   return 0;
 }
\ No newline at end of file
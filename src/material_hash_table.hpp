@@ -0,0 +1,67 @@
+#pragma once
+#ifndef MATERIAL_HASH_TABLE_HPP
+#define MATERIAL_HASH_TABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "endgame.hpp"
+#include "utils.hpp"
+
+namespace chess {
+
+// The endgame score is multiplied by the scale factor of the side that is
+// ahead and divided by this value.
+constexpr int kNormalScaleFactor = 64;
+
+// The evaluation of a material signature. Everything in it depends only on
+// the number of pieces of each type, so it can be shared by every position
+// with the same material key.
+struct MaterialEntry {
+  Key key = 0;
+
+  // The material imbalance score of white minus that of black.
+  Score imbalance = kScoreZero;
+
+  // The endgame scale factor of each side, used when that side is ahead.
+  int scale_factors[kNumColors] = {kNormalScaleFactor, kNormalScaleFactor};
+
+  // The evaluation function of a recognized material signature, or nullptr
+  // if the position is evaluated normally.
+  EndgameFunction endgame_function = nullptr;
+  Color strong_side = kWhite;
+};
+
+// Caches the evaluation of material signatures by material key. The material
+// only changes on captures and promotions, so nearly every evaluation finds
+// its signature here. Each search engine owns its own table, so it is never
+// shared between threads.
+class MaterialHashTable {
+ public:
+  MaterialHashTable() : table_(kMaterialHashTableSize) {}
+
+  // Returns the entry the given key is stored in. The entry belongs to the key
+  // only if its key matches, otherwise it can be overwritten.
+  // @param key The material key.
+  // @return The entry for the key.
+  inline MaterialEntry &Probe(Key key);
+
+  // Clears the table.
+  inline void Clear();
+
+ private:
+  std::vector<MaterialEntry> table_;
+};
+
+inline MaterialEntry &MaterialHashTable::Probe(Key key) {
+  return table_[key & (kMaterialHashTableSize - 1)];
+}
+
+inline void MaterialHashTable::Clear() {
+  std::fill(table_.begin(), table_.end(), MaterialEntry());
+}
+
+}  // namespace chess
+
+#endif  // MATERIAL_HASH_TABLE_HPP
@@ -385,6 +385,109 @@ void GenerateKingMoves(const Position& pos, move::MoveList& moveList) {
   }
 }
 
+Bitboard AttackersTo(const Position& pos, Square square, Bitboard occupancy) {
+  const Bitboard* pieces = pos.state_.piece_bitboards;
+  Bitboard diagonal = pieces[kWhiteBishop] | pieces[kBlackBishop] |
+                      pieces[kWhiteQueen] | pieces[kBlackQueen];
+  Bitboard straight = pieces[kWhiteRook] | pieces[kBlackRook] |
+                      pieces[kWhiteQueen] | pieces[kBlackQueen];
+
+  return (precomputed_data::pawn_attacks[square][kBlack] &
+          pieces[kWhitePawn]) |
+         (precomputed_data::pawn_attacks[square][kWhite] &
+          pieces[kBlackPawn]) |
+         (precomputed_data::knight_attacks[square] &
+          (pieces[kWhiteKnight] | pieces[kBlackKnight])) |
+         (precomputed_data::king_attacks[square] &
+          (pieces[kWhiteKing] | pieces[kBlackKing])) |
+         (precomputed_data::GetBishopAttacks(square, occupancy) & diagonal) |
+         (precomputed_data::GetRookAttacks(square, occupancy) & straight);
+}
+
+bool StaticExchangeAtLeast(const Position& pos, move::Move move,
+                           int threshold) {
+  // Castles and promotions are not exchanges
+  if (move::IsCastle(move) || move::GetPromotedPiece(move) != kNoPiece) {
+    return threshold <= 0;
+  }
+
+  Square source = move::GetSourceSquare(move);
+  Square target = move::GetTargetSquare(move);
+  Piece piece = move::GetPiece(move);
+  Color side = GetPieceColor(piece);
+
+  // The balance is the material gained so far minus the threshold, from the
+  // point of view of the side that made the last capture
+  int balance = -threshold;
+  if (move::IsEnPassant(move)) {
+    balance += kSeeValues[kPawn];
+  } else if (move::IsCapture(move)) {
+    balance += kSeeValues[GetPieceType(pos.PieceOn(target))];
+  }
+  if (balance < 0) return false;
+
+  // Even if the moved piece is lost the move is good enough
+  balance -= kSeeValues[GetPieceType(piece)];
+  if (balance >= 0) return true;
+
+  Bitboard occupancy = pos.state_.piece_occupancy[kBothColors];
+  ClearBit(occupancy, source);
+  if (move::IsEnPassant(move)) {
+    ClearBit(occupancy, side == kWhite ? target + kSouth : target + kNorth);
+  }
+
+  const Bitboard* pieces = pos.state_.piece_bitboards;
+  Bitboard diagonal = pieces[kWhiteBishop] | pieces[kBlackBishop] |
+                      pieces[kWhiteQueen] | pieces[kBlackQueen];
+  Bitboard straight = pieces[kWhiteRook] | pieces[kBlackRook] |
+                      pieces[kWhiteQueen] | pieces[kBlackQueen];
+  Bitboard attackers = AttackersTo(pos, target, occupancy) & occupancy;
+
+  // Each side captures with its least valuable attacker until a side runs out
+  // of attackers or would stop because the capture loses material. The side
+  // that made the last good capture wins the exchange.
+  Color current_side = side;
+  while (true) {
+    current_side = ~current_side;
+    Bitboard side_attackers =
+        attackers & pos.state_.piece_occupancy[current_side];
+    if (!side_attackers) break;
+
+    PieceType attacker_type = kPawn;
+    while (!(side_attackers & pieces[GetPiece(attacker_type, current_side)])) {
+      attacker_type = static_cast<PieceType>(attacker_type + 1);
+    }
+
+    // The king can only capture if the square is no longer defended
+    if (attacker_type == kKing &&
+        (attackers & pos.state_.piece_occupancy[~current_side])) {
+      break;
+    }
+
+    side_attackers &= pieces[GetPiece(attacker_type, current_side)];
+    ClearBit(occupancy, GetLSBIndex(side_attackers));
+
+    // Capturing may reveal sliding attackers behind the piece
+    if (attacker_type == kPawn || attacker_type == kBishop ||
+        attacker_type == kQueen) {
+      attackers |= precomputed_data::GetBishopAttacks(target, occupancy) &
+                   diagonal;
+    }
+    if (attacker_type == kRook || attacker_type == kQueen) {
+      attackers |=
+          precomputed_data::GetRookAttacks(target, occupancy) & straight;
+    }
+    attackers &= occupancy;
+
+    balance = -balance - 1 - kSeeValues[attacker_type];
+    side = current_side;
+    if (balance >= 0) break;
+  }
+
+  // The side that made the last capture wins the exchange
+  return side == GetPieceColor(piece);
+}
+
 bool IsSquareAttacked(const Position& pos, Square square, Color side) {
   Color attacking_side = side;
   Color defending_side = ~attacking_side;
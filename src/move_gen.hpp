@@ -196,6 +196,28 @@ void GenerateKingMoves(const Position& pos, move::MoveList& moveList);
 // @param color The attacking color.
 bool IsSquareAttacked(const Position& pos, Square square, Color color);
 
+// The piece values used by the static exchange evaluation, indexed by piece
+// type.
+constexpr int kSeeValues[kPieceTypeCount] = {100, 300, 300, 500, 900, 0};
+
+// Returns all pieces of both colors that attack the given square.
+// @param pos The position.
+// @param square The square.
+// @param occupancy The pieces that block sliding attacks.
+// @return The attacking pieces.
+Bitboard AttackersTo(const Position& pos, Square square, Bitboard occupancy);
+
+// Returns whether the static exchange evaluation of the given move is at
+// least the given threshold. The exchange on the target square is played out
+// with the least valuable attacker each time. Pins are ignored.
+// More info: https://www.chessprogramming.org/Static_Exchange_Evaluation
+// @param pos The position.
+// @param move The move.
+// @param threshold The material the move must gain, in centipawns.
+// @return Whether the move gains at least the threshold.
+bool StaticExchangeAtLeast(const Position& pos, move::Move move,
+                           int threshold);
+
 // Returns whether the board is in check.
 // @param pos The position.
 // @return Whether the board is in check.
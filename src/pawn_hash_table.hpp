@@ -0,0 +1,77 @@
+#pragma once
+#ifndef PAWN_HASH_TABLE_HPP
+#define PAWN_HASH_TABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "search_stats.hpp"
+#include "utils.hpp"
+
+namespace chess {
+
+// The evaluation of a pawn structure. Everything in it depends only on the
+// pawns of both sides, so it can be shared by every position with the same
+// pawn key.
+struct PawnEntry {
+  Key key = 0;
+
+  // The pawn structure score of white minus that of black.
+  Score score = kScoreZero;
+
+  // The passed pawns of each side.
+  Bitboard passed_pawns[kNumColors] = {0, 0};
+
+  // The squares each side's pawns can attack as they advance.
+  Bitboard attack_spans[kNumColors] = {0, 0};
+
+  // The files that have at least one pawn of each side, bit n for file n.
+  // An empty entry is the correct entry for a position without pawns, whose
+  // pawn key is 0.
+  uint8_t pawn_files[kNumColors] = {0, 0};
+};
+
+// Caches the evaluation of pawn structures by pawn key. Pawn moves are rare
+// compared to other moves, so most evaluations find their pawn structure
+// here. Each search engine owns its own table, so it is never shared between
+// threads.
+class PawnHashTable {
+ public:
+  // The number of probes and hits, only counted in stats builds.
+  uint64_t probes_ = 0;
+  uint64_t hits_ = 0;
+
+  PawnHashTable() : table_(kPawnHashTableSize) {}
+
+  // Returns the entry the given key is stored in. The entry belongs to the key
+  // only if its key matches, otherwise it can be overwritten.
+  // @param key The pawn key.
+  // @return The entry for the key.
+  inline PawnEntry &Probe(Key key);
+
+  // Clears the table.
+  inline void Clear();
+
+ private:
+  std::vector<PawnEntry> table_;
+};
+
+inline PawnEntry &PawnHashTable::Probe(Key key) {
+  PawnEntry &entry = table_[key & (kPawnHashTableSize - 1)];
+  if constexpr (kCollectSearchStats) {
+    probes_++;
+    if (entry.key == key) hits_++;
+  }
+  return entry;
+}
+
+inline void PawnHashTable::Clear() {
+  std::fill(table_.begin(), table_.end(), PawnEntry());
+  probes_ = 0;
+  hits_ = 0;
+}
+
+}  // namespace chess
+
+#endif  // PAWN_HASH_TABLE_HPP
@@ -1,8 +1,12 @@
 #include "position.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <utility>
 
+#include "evaluator.hpp"
+#include "precomputed_data.hpp"
 #include "utils.hpp"
 
 namespace chess {
@@ -16,19 +20,74 @@ Key side_key;
 void Init() {
   for (Piece p = kWhitePawn; p <= kBlackKing; p++) {
     for (Square s = kSquareStart; s < kNumSquares; s++) {
-      piece_keys[p][s] = GetRandomNumber64();
+      piece_keys[p][s] = GetRandomKey();
     }
   }
   for (Square s = kSquareStart; s < kNumSquares; s++) {
-    en_passant_keys[s] = GetRandomNumber64();
+    en_passant_keys[s] = GetRandomKey();
   }
   for (CastlingRights c = kCastlingRightsStart; c < 16; c++) {
-    castling_keys[c] = GetRandomNumber64();
+    castling_keys[c] = GetRandomKey();
   }
-  side_key = GetRandomNumber64();
+  side_key = GetRandomKey();
 }
 }  // namespace zobrist
 
+namespace cuckoo {
+Key keys[kTableSize];
+move::Move moves[kTableSize];
+
+void Init() {
+  std::fill(std::begin(keys), std::end(keys), 0);
+  std::fill(std::begin(moves), std::end(moves), 0);
+
+  for (Piece p = kWhitePawn; p <= kBlackKing; p++) {
+    // Pawn moves are never reversible
+    if (GetPieceType(p) == kPawn) continue;
+
+    for (Square s1 = kSquareStart; s1 < kNumSquares; s1++) {
+      Bitboard attacks;
+      switch (GetPieceType(p)) {
+        case kKnight:
+          attacks = precomputed_data::knight_attacks[s1];
+          break;
+        case kBishop:
+          attacks = precomputed_data::GetBishopAttacks(s1, kEmptyBitboard);
+          break;
+        case kRook:
+          attacks = precomputed_data::GetRookAttacks(s1, kEmptyBitboard);
+          break;
+        case kQueen:
+          attacks = precomputed_data::GetQueenAttacks(s1, kEmptyBitboard);
+          break;
+        default:
+          attacks = precomputed_data::king_attacks[s1];
+          break;
+      }
+
+      // A move and its reverse have the same key, so only store one of them
+      for (Square s2 = static_cast<Square>(s1 + 1); s2 < kNumSquares; s2++) {
+        if (!GetBit(attacks, s2)) continue;
+
+        move::Move move =
+            move::CreateMove(s1, s2, p, kNoPiece, false, false, false, false);
+        Key key = zobrist::piece_keys[p][s1] ^ zobrist::piece_keys[p][s2] ^
+                  zobrist::side_key;
+
+        // Insert the move, moving any move in the way to its other index
+        int index = FirstIndex(key);
+        while (true) {
+          std::swap(keys[index], key);
+          std::swap(moves[index], move);
+          if (move == 0) break;
+          index = index == FirstIndex(key) ? SecondIndex(key) : FirstIndex(key);
+        }
+      }
+    }
+  }
+}
+}  // namespace cuckoo
+
 std::ostream& operator<<(std::ostream& os, const Position& pos) {
   os << "\n  --- --- --- --- --- --- --- --- \n";
 
@@ -77,6 +136,44 @@ Key Position::GenerateKey() const {
   return key;
 }
 
+Key Position::GeneratePawnKey() const {
+  Key key = 0;
+  for (Piece p : {kWhitePawn, kBlackPawn}) {
+    Bitboard b = state_.piece_bitboards[p];
+    while (b) {
+      Square square = static_cast<Square>(GetLSBIndex(b));
+      key ^= zobrist::piece_keys[p][square];
+      ClearLSB(b);
+    }
+  }
+  return key;
+}
+
+Key Position::GenerateMaterialKey() const {
+  Key key = 0;
+  for (Piece p = kWhitePawn; p <= kBlackKing; ++p) {
+    for (int i = 0; i < CountBits(state_.piece_bitboards[p]); i++) {
+      key ^= zobrist::piece_keys[p][i];
+    }
+  }
+  return key;
+}
+
+void Position::GenerateEvalScores() {
+  state_.psq_score = kScoreZero;
+  state_.game_phase = 0;
+  for (Piece p = kWhitePawn; p <= kBlackKing; ++p) {
+    int sign = GetPieceColor(p) == kWhite ? 1 : -1;
+    Bitboard b = state_.piece_bitboards[p];
+    while (b) {
+      Square square = static_cast<Square>(GetLSBIndex(b));
+      state_.psq_score += sign * kPieceSquareTables[p][square];
+      state_.game_phase += kGamePhaseInc[p];
+      ClearLSB(b);
+    }
+  }
+}
+
 void Position::Set(const std::string& fen) {
   int i = 0;
   Square sq = kA8;
@@ -162,11 +259,15 @@ void Position::Set(const std::string& fen) {
       i++;
     }
     state_.halfmove_clock = std::stoi(halfmove_clock_str);
+    state_.plies_from_null = state_.halfmove_clock;
     state_.ply = (2 * (std::stoi(fullmove_number_str) - 1)) +
                  (state_.side_to_move == kBlack);
 
-    // Generate the Zobrist key.
+    // Generate the Zobrist keys and the evaluation scores.
     state_.key = GenerateKey();
+    state_.pawn_key = GeneratePawnKey();
+    state_.material_key = GenerateMaterialKey();
+    GenerateEvalScores();
 
   } catch (const std::exception& e) {
     throw std::invalid_argument("Invalid FEN string.");
@@ -200,22 +301,40 @@ bool Position::MakeMove(move::Move move, bool quiescencse) {
 
   // Update the ply.
   state_.ply++;
+  state_.plies_from_null++;
 
-  // If the move is a capture, get the captured piece.
+  // If the move is a capture, get the captured piece. The target square of
+  // an en passant capture is empty, the pawn is handled below.
   Piece captured_piece = PieceOn(target);
 
+  // The scores are from white's point of view
+  int sign = GetPieceColor(piece) == kWhite ? 1 : -1;
+
   // Move the piece.
   ClearBit(state_.piece_bitboards[piece], source);
   SetBit(state_.piece_bitboards[piece], target);
 
-  // Update the hash key.
+  // Update the hash key and the scores.
   state_.key ^= zobrist::piece_keys[piece][source];
   state_.key ^= zobrist::piece_keys[piece][target];
+  state_.psq_score += sign * (kPieceSquareTables[piece][target] -
+                              kPieceSquareTables[piece][source]);
+  if (GetPieceType(piece) == kPawn) {
+    state_.pawn_key ^= zobrist::piece_keys[piece][source];
+    state_.pawn_key ^= zobrist::piece_keys[piece][target];
+  }
 
   // Handle captures.
-  if (capture) {
+  if (capture && !en_passant) {
     ClearBit(state_.piece_bitboards[captured_piece], target);
     state_.key ^= zobrist::piece_keys[captured_piece][target];
+    state_.material_key ^= zobrist::piece_keys[captured_piece][CountBits(
+        state_.piece_bitboards[captured_piece])];
+    state_.psq_score += sign * kPieceSquareTables[captured_piece][target];
+    state_.game_phase -= kGamePhaseInc[captured_piece];
+    if (GetPieceType(captured_piece) == kPawn) {
+      state_.pawn_key ^= zobrist::piece_keys[captured_piece][target];
+    }
   }
 
   // Handle promotions.
@@ -224,6 +343,14 @@ bool Position::MakeMove(move::Move move, bool quiescencse) {
     SetBit(state_.piece_bitboards[promoted_piece], target);
     state_.key ^= zobrist::piece_keys[piece][target];
     state_.key ^= zobrist::piece_keys[promoted_piece][target];
+    state_.material_key ^=
+        zobrist::piece_keys[piece][CountBits(state_.piece_bitboards[piece])];
+    state_.material_key ^= zobrist::piece_keys[promoted_piece][CountBits(
+        state_.piece_bitboards[promoted_piece]) - 1];
+    state_.psq_score += sign * (kPieceSquareTables[promoted_piece][target] -
+                                kPieceSquareTables[piece][target]);
+    state_.game_phase += kGamePhaseInc[promoted_piece];
+    state_.pawn_key ^= zobrist::piece_keys[piece][target];
   }
 
   // Handle en passant
@@ -237,6 +364,11 @@ bool Position::MakeMove(move::Move move, bool quiescencse) {
     Piece captured_piece = GetPiece(kPawn, ~GetPieceColor(piece));
     ClearBit(state_.piece_bitboards[captured_piece], en_passant_target);
     state_.key ^= zobrist::piece_keys[captured_piece][en_passant_target];
+    state_.psq_score +=
+        sign * kPieceSquareTables[captured_piece][en_passant_target];
+    state_.pawn_key ^= zobrist::piece_keys[captured_piece][en_passant_target];
+    state_.material_key ^= zobrist::piece_keys[captured_piece][CountBits(
+        state_.piece_bitboards[captured_piece])];
   }
   // hash en passant square
   if (state_.en_passant_square != kNoSquare) {
@@ -272,6 +404,9 @@ bool Position::MakeMove(move::Move move, bool quiescencse) {
       rook_source = kA8;
       rook_target = kD8;
     }
+    Piece rook = GetPiece(kRook, GetPieceColor(piece));
+    state_.psq_score += sign * (kPieceSquareTables[rook][rook_target] -
+                                kPieceSquareTables[rook][rook_source]);
     ClearBit(state_.piece_bitboards[GetPiece(kRook, GetPieceColor(piece))],
              rook_source);
     SetBit(state_.piece_bitboards[GetPiece(kRook, GetPieceColor(piece))],
@@ -315,6 +450,38 @@ bool Position::MakeMove(move::Move move, bool quiescencse) {
   return true;
 }
 
+bool Position::HasUpcomingRepetition(int ply) const {
+  // Only cycles completed inside the search are counted, the positions before
+  // the root are handled by the normal repetition check. Positions before the
+  // last null move cannot be reached.
+  int last = std::min({state_.halfmove_clock, state_.plies_from_null,
+                       repetition_table_.size(), ply - 1});
+  if (last < 3) return false;
+
+  Bitboard occupancy = state_.piece_occupancy[kBothColors];
+  int size = repetition_table_.size();
+
+  // A single move changes the side to move, so only every second position
+  // starting three plies back can be reached
+  for (int distance = 3; distance <= last; distance += 2) {
+    Key move_key = state_.key ^ repetition_table_.Get(size - distance);
+
+    int index = cuckoo::FirstIndex(move_key);
+    if (cuckoo::keys[index] != move_key) {
+      index = cuckoo::SecondIndex(move_key);
+      if (cuckoo::keys[index] != move_key) continue;
+    }
+
+    // The move can only be made if nothing is in the way
+    move::Move move = cuckoo::moves[index];
+    Bitboard between =
+        precomputed_data::between_squares[move::GetSourceSquare(move)]
+                                         [move::GetTargetSquare(move)];
+    if (!(between & occupancy)) return true;
+  }
+  return false;
+}
+
 int Position::GetNumNonPawnKingPieces(Color side) const {
   Bitboard bitboard = state_.piece_occupancy[side];
   bitboard &= ~state_.piece_bitboards[GetPiece(kPawn, side)];
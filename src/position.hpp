@@ -20,8 +20,22 @@ struct PositionState {
   Square en_passant_square;
   CastlingRights castling_rights;
   Key key;
+  // The Zobrist key of the pawns only, used to index the pawn hash table.
+  Key pawn_key;
+  // The Zobrist key of the number of pieces of each type, used to index the
+  // material hash table.
+  Key material_key;
   int halfmove_clock;
+  // The plies since the last null move, or since the position was set if
+  // there was none. Repetitions are only searched for this far back, since
+  // the positions before a null move cannot be reached by legal moves.
+  int plies_from_null;
   int ply;
+  // The material and piece-square score of white minus that of black, and
+  // the game phase of the pieces on the board. Updated by MakeMove so the
+  // evaluation does not have to sum them.
+  Score psq_score;
+  int game_phase;
 };
 
 namespace zobrist {
@@ -36,6 +50,32 @@ void Init();
 
 }  // namespace zobrist
 
+// Cuckoo tables of every reversible move, used to detect that a position can
+// repeat after a single move. The key of a move is the change it makes to the
+// Zobrist key of a position. Each move is stored at one of two indices derived
+// from its key.
+// More info: https://www.chessprogramming.org/Cuckoo_Hashing
+namespace cuckoo {
+
+constexpr int kTableSize = 8192;
+
+extern Key keys[kTableSize];
+extern move::Move moves[kTableSize];
+
+// Returns the first possible index of the given key.
+constexpr inline int FirstIndex(Key key) { return key & (kTableSize - 1); }
+
+// Returns the second possible index of the given key.
+constexpr inline int SecondIndex(Key key) {
+  return (key >> 16) & (kTableSize - 1);
+}
+
+// Initializes the cuckoo tables. Must be called after the Zobrist keys and the
+// precomputed attacks are initialized.
+void Init();
+
+}  // namespace cuckoo
+
 // Represents a chess position.
 class Position {
  public:
@@ -71,6 +111,19 @@ class Position {
   // @return The Zobrist key for the current position.
   Key GenerateKey() const;
 
+  // Generates the Zobrist key of the pawns in the current position.
+  // @return The pawn key for the current position.
+  Key GeneratePawnKey() const;
+
+  // Generates the material key for the current position. The nth piece of a
+  // type is hashed with the key of that piece on square n.
+  // @return The material key for the current position.
+  Key GenerateMaterialKey() const;
+
+  // Sums the material and piece-square scores and the game phase of the
+  // pieces on the board into the current state.
+  void GenerateEvalScores();
+
   // Generates the occupancy bitboards for the white pieces.
   void GenerateWhiteOccupancies();
 
@@ -86,6 +139,13 @@ class Position {
   // @return If the move was legal.
   bool MakeMove(move::Move move, bool quiescencse);
 
+  // Returns whether the side to move has a reversible move that repeats a
+  // position from earlier in the search. Only positions since the last pawn
+  // move or capture are checked.
+  // @param ply The number of plies since the root of the search.
+  // @return Whether a move leads to a repetition.
+  bool HasUpcomingRepetition(int ply) const;
+
   // Gets the number of non pawn or king pieces on the board.
   // @return The number of non pawn or king pieces on the board.
   int GetNumNonPawnKingPieces(Color side) const;
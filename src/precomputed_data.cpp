@@ -14,8 +14,7 @@ Bitboard bishop_attacks[kNumSquares][512];
 Bitboard rook_masks[kNumSquares];
 Bitboard rook_attacks[kNumSquares][4096];
 
-Bitboard isolated_pawn_masks[kNumSquares];
-Bitboard passed_pawn_masks[kNumSquares][kNumColors];
+Bitboard between_squares[kNumSquares][kNumSquares];
 
 void Init() {
   // The relevant bits are already precomputed, this only needs to be called if
@@ -28,7 +27,7 @@ void Init() {
 
   InitSlidingAttacks();
   InitLeapingAttacks();
-  InitEvaluationMasks();
+  InitBetweenSquares();
 }
 
 void InitMagicNumbers() {
@@ -83,36 +82,25 @@ void InitLeapingAttacks() {
   }
 }
 
-void InitEvaluationMasks() {
-  // Init isolated pawn masks.
-  for (File f = kAFile; f <= kHFile; f++) {
-    for (Rank r = kRank1; r <= kRank8; r++) {
-      Bitboard mask = kEmptyBitboard;
-      if (f != kAFile) mask |= kFileMasks[f - 1];
-      if (f != kHFile) mask |= kFileMasks[f + 1];
-      isolated_pawn_masks[GetSquare(f, r)] = mask;
-    }
-  }
-
-  // Init passed pawn masks.
-  for (File f = kAFile; f <= kHFile; f++) {
-    for (Rank r = kRank1; r <= kRank8; r++) {
-      for (Color c = kWhite; c <= kBlack; c++) {
-        Bitboard mask = kEmptyBitboard;
-        if (f != kAFile) mask |= kFileMasks[f - 1];
-        mask |= kFileMasks[f];
-        if (f != kHFile) mask |= kFileMasks[f + 1];
-        if (c == kWhite) {
-          for (Rank passed_rank = kRank1; passed_rank <= r; passed_rank++) {
-            mask &= ~kRankMasks[passed_rank];
-          }
-        } else {
-          for (Rank passed_rank = kRank8; passed_rank >= r; passed_rank--) {
-            mask &= ~kRankMasks[passed_rank];
-          }
-        }
-        passed_pawn_masks[GetSquare(f, r)][c] = mask;
+void InitBetweenSquares() {
+  for (Square s1 = kSquareStart; s1 < kNumSquares; s1++) {
+    for (Square s2 = kSquareStart; s2 < kNumSquares; s2++) {
+      Bitboard s1_bitboard = kEmptyBitboard;
+      Bitboard s2_bitboard = kEmptyBitboard;
+      SetBit(s1_bitboard, s1);
+      SetBit(s2_bitboard, s2);
+
+      // The squares between are the squares that a slider on either square
+      // attacks when the other square is blocked
+      Bitboard between = kEmptyBitboard;
+      if (GetBit(GenerateBishopAttacks(s1, kEmptyBitboard), s2)) {
+        between = GenerateBishopAttacks(s1, s2_bitboard) &
+                  GenerateBishopAttacks(s2, s1_bitboard);
+      } else if (GetBit(GenerateRookAttacks(s1, kEmptyBitboard), s2)) {
+        between = GenerateRookAttacks(s1, s2_bitboard) &
+                  GenerateRookAttacks(s2, s1_bitboard);
       }
+      between_squares[s1][s2] = between;
     }
   }
 }
@@ -26,8 +26,9 @@ extern int rook_relevant_bits[kNumSquares];
 extern Key bishop_magic_numbers[kNumSquares];
 extern Key rook_magic_numbers[kNumSquares];
 
-extern Bitboard isolated_pawn_masks[kNumSquares];
-extern Bitboard passed_pawn_masks[kNumSquares][kNumColors];
+// The squares strictly between two squares on the same rank, file or
+// diagonal. Empty if the squares are not aligned.
+extern Bitboard between_squares[kNumSquares][kNumSquares];
 
 // Initializes the precomputed data.
 void Init();
@@ -44,8 +45,8 @@ void InitSlidingAttacks();
 // Initializes the leaping piece attacks.
 void InitLeapingAttacks();
 
-// Initializes the evaluation masks.
-void InitEvaluationMasks();
+// Initializes the squares between every pair of aligned squares.
+void InitBetweenSquares();
 
 // Finds the magic number for a sliding piece.
 // More info: https://www.chessprogramming.org/Looking_for_Magics
@@ -2,19 +2,22 @@
 #ifndef REPETITION_TABLE_HPP
 #define REPETITION_TABLE_HPP
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <vector>
 
 #include "utils.hpp"
 
 namespace chess {
 
+// Stores the keys of the positions before the current one, from the start of
+// the game through the current search path. A small counting filter indexed by
+// the key tells in O(1) whether a key can be in the table at all, so most
+// lookups never scan the keys.
 class RepetitionTable {
  public:
-  std::array<Key, kRepetitionTableSize> table;
-  int head = 0;
-  int tail = 0;
-  bool full = false;
+  RepetitionTable() { keys_.reserve(kRepetitionTableSize); }
 
   // Adds the given key to the table.
   // @param key The key to add.
@@ -25,89 +28,101 @@ class RepetitionTable {
 
   // Returns whether the table is empty.
   // @return Whether the table is empty.
-  inline bool IsEmpty();
+  inline bool IsEmpty() const;
 
-  // Returns the key at the given index.
+  // Returns the key at the given index, where index 0 is the oldest key.
   // @param index The index to get the key from.
   // @return The key at the given index.
-  inline Key Get(int index);
+  inline Key Get(int index) const;
 
   // Returns the size of the table.
   // @return The size of the table.
-  inline int size();
-
-  // Returns whether the table contains the given key within the last 100 moves.
-  // Only 100 moves are checked because it is impossible to have a repetition
-  // before then. This is because a position cannot be repeated after a pawn
-  // move or capture occurs and if no pawn moves or captures occured in the last
-  // 50 moves the game would be drawn.
-  // @param key The key to check for.
-  // @return Whether the table contains the given key.
-  inline bool HasRepetition(Key key);
-
-  // Returns the number of times the given key appears in the table.
-  // Only the most recent 100 moves are checked.
+  inline int size() const;
+
+  // Returns whether the given key is the key of an earlier position that can be
+  // repeated. Positions can only repeat with the same side to move, so only
+  // every second key is checked, and a pawn move, a capture or a null move
+  // makes all earlier positions unreachable, so only the last halfmove_clock
+  // keys are checked.
+  // @param key The key of the current position.
+  // @param halfmove_clock The halfmove clock of the current position, or the
+  // plies since the last null move if that is smaller.
+  // @return Whether the position is a repetition.
+  inline bool HasRepetition(Key key, int halfmove_clock) const;
+
+  // Returns the number of times the given key appears in the table within the
+  // last halfmove_clock keys.
   // @param key The key to count.
+  // @param halfmove_clock The halfmove clock of the current position.
   // @return The number of times the given key appears in the table.
-  inline int CountRepetitions(Key key);
+  inline int CountRepetitions(Key key, int halfmove_clock) const;
 
   // Clears the table.
   inline void Clear();
+
+ private:
+  // Returns the filter index of the given key. The high bits are used because
+  // the transposition table is indexed by the low bits.
+  // @param key The key.
+  // @return The filter index.
+  static constexpr inline int FilterIndex(Key key);
+
+  std::vector<Key> keys_;
+
+  // The number of keys in the table for each filter index.
+  std::array<uint16_t, 1 << kRepetitionFilterBits> filter_ = {};
 };
 
+constexpr inline int RepetitionTable::FilterIndex(Key key) {
+  return static_cast<int>(key >> (64 - kRepetitionFilterBits));
+}
+
 inline void RepetitionTable::Add(Key key) {
-  table[head] = key;
-  head = (head + 1) % kRepetitionTableSize;
-  if (full) tail = (tail + 1) % kRepetitionTableSize;
-  full = head == tail;
+  keys_.push_back(key);
+  filter_[FilterIndex(key)]++;
 }
 
 inline void RepetitionTable::RemoveLast() {
   if (IsEmpty()) return;
-  head = (head - 1 + kRepetitionTableSize) % kRepetitionTableSize;
-  full = false;
+  filter_[FilterIndex(keys_.back())]--;
+  keys_.pop_back();
 }
 
-inline bool RepetitionTable::IsEmpty() { return !full && (head == tail); }
+inline bool RepetitionTable::IsEmpty() const { return keys_.empty(); }
 
-inline Key RepetitionTable::Get(int index) {
-  return table[(tail + index) % kRepetitionTableSize];
-}
+inline Key RepetitionTable::Get(int index) const { return keys_[index]; }
 
-inline int RepetitionTable::size() {
-  if (full) {
-    return kRepetitionTableSize;
-  } else {
-    return (head + kRepetitionTableSize - tail) % kRepetitionTableSize;
-  }
-}
+inline int RepetitionTable::size() const { return keys_.size(); }
 
-inline bool RepetitionTable::HasRepetition(Key key) {
-  int recent_positions = std::min(size(), 100);
-  for (int i = 0; i < recent_positions; i++) {
-    if (Get(size() - i - 1) == key) {
-      return true;
-    }
+inline bool RepetitionTable::HasRepetition(Key key, int halfmove_clock) const {
+  if (filter_[FilterIndex(key)] == 0) return false;
+
+  // The closest position with the same side to move that can be the same is
+  // four plies back
+  int last = std::min(halfmove_clock, size());
+  for (int distance = 4; distance <= last; distance += 2) {
+    if (keys_[size() - distance] == key) return true;
   }
   return false;
 }
 
-inline int RepetitionTable::CountRepetitions(Key key) {
+inline int RepetitionTable::CountRepetitions(Key key,
+                                            int halfmove_clock) const {
+  if (filter_[FilterIndex(key)] == 0) return 0;
+
   int count = 0;
-  int recent_positions = std::min(size(), 100);
-  for (int i = 0; i < recent_positions; i++) {
-    if (Get(size() - i - 1) == key) {
-      count++;
-    }
+  int last = std::min(halfmove_clock, size());
+  for (int distance = 4; distance <= last; distance += 2) {
+    if (keys_[size() - distance] == key) count++;
   }
   return count;
 }
 
 inline void RepetitionTable::Clear() {
-  head = tail = 0;
-  full = false;
+  keys_.clear();
+  filter_.fill(0);
 }
 
 }  // namespace chess
 
-#endif  // REPETITION_TABLE_HPP
\ No newline at end of file
+#endif  // REPETITION_TABLE_HPP
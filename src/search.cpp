@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <cstring>
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 #include "evaluator.hpp"
@@ -14,95 +16,86 @@ namespace chess {
 void SearchEngine::Search(Position &position) {
   start_time_ = GetTime() - 1;  // Subtract 1 to prevent divide by 0 errors
 
+  InitRootMoves(position);
+  int legal_moves = root_moves_.size();
+
   // Determine the time to search
   int time_remaining =
       position.state_.side_to_move == kWhite ? white_time_ : black_time_;
   int increment =
       position.state_.side_to_move == kWhite ? white_inc_ : black_inc_;
-  if (engine_decides_search_params_) {
-    if (time_remaining == 0) {
-      engine_decides_search_params_ = false;
-    } else if (time_remaining < kTimeBuffer) {
-      engine_decides_search_params_ = false;
-      search_depth_ = 1;
-    } else {
-      time_remaining -= kTimeBuffer;
-      if (moves_to_go_ == 0) moves_to_go_ = kDefaultMovesToGo;
-      end_time_ = start_time_ + (time_remaining / moves_to_go_) + increment;
-    }
-  };
+  timed_search_ = false;
+  if (move_time_ != 0) {
+    time_manager_.InitFixed(start_time_, move_time_);
+    timed_search_ = true;
+  } else if (engine_decides_search_params_ && time_remaining != 0) {
+    time_manager_.Init(start_time_, time_remaining, increment, moves_to_go_,
+                       legal_moves);
+    timed_search_ = true;
+  }
+
+  // A ponder search has no deadline until ponderhit, when the clock starts
+  ponder_search_ = pondering_;
+  end_time_ = 0;
+  if (timed_search_ && !ponder_search_) {
+    end_time_ = time_manager_.GetHardDeadline();
+    stop_timer_.Arm(end_time_);
+  }
 
   // Reset the search variables for a new search
   memset(killer_moves_, 0, sizeof(killer_moves_));
-  memset(history_moves_, 0, sizeof(history_moves_));
   bool printed_info = false;
   nodes = 0;
+  stats_.Clear();
+  iteration_start_stats_.Clear();
+  eval_tables_.eval_cache.ResetCounters();
+  eval_tables_.lazy_evals = 0;
+  eval_tables_.pawn_table.probes_ = 0;
+  eval_tables_.pawn_table.hits_ = 0;
+  previous_iteration_nodes_ = 0;
   ply = 0;
   current_depth_ = 1;
   score = kUnknownScore;
-  int temp_score = kUnknownScore;
-  int alpha = -kInfinity;
-  int beta = kInfinity;
+  previous_score_ = kUnknownScore;
+  aspiration_researches_ = 0;
+  null_move_min_ply_ = 0;
+
+  // Each MultiPV line excludes the first moves of the lines before it, so
+  // there cannot be more lines than legal moves
+  int num_lines = std::max(1, std::min(multi_pv_, legal_moves));
+  lines_.assign(num_lines, SearchLine());
 
   // Check if we should stop the search
   CheckStop();
 
   // Iterative deepening loop, always does at least one iteration
   do {
-    PvLine new_pv_line;
     printed_info = false;
+    SortRootMoves();
 
-    // Perform aspiration window search
-    temp_score =
-        Negamax(alpha, beta, current_depth_, position, &new_pv_line, false);
-
-    // Check if we are outside of the kAspirationWindow
-    if (temp_score <= alpha || temp_score >= beta) {
-      // If we are outside of the kAspirationWindow, do a full depth search
-      temp_score = Negamax(-kInfinity, kInfinity, current_depth_, position,
-                           &new_pv_line, false);
+    // Search each line in turn. They share the transposition table and the
+    // histories, so the later lines are much cheaper than a separate search.
+    for (pv_index_ = 0; pv_index_ < num_lines && !stop_search_; pv_index_++) {
+      SearchCurrentLine(position);
     }
 
-    // If the search was stopped, check if we should use the new PV line
-    if (stop_search_) {
-      // If the new PV line has the same first move then it is a more accurate
-      // evaluation so we should use it
-      if (new_pv_line.moves[0] == pv_line_.moves[0]) {
-        score = temp_score;
-        for (int i = 0; i < new_pv_line.count; i++) {
-          pv_line_.moves[i] = new_pv_line.moves[i];
-        }
-        pv_line_.count = new_pv_line.count;
-      } else if (temp_score > score) {
-        // If the new PV line is better than the old one then we should use it
-        score = temp_score;
-        for (int i = 0; i < new_pv_line.count; i++) {
-          pv_line_.moves[i] = new_pv_line.moves[i];
-        }
-        pv_line_.count = new_pv_line.count;
-      } else {
-        // Otherwise we cannot trust the new PV line so we should just use the
-        // old one
-        current_depth_--;  // Decrement the depth because we didn't find any new
-                           // info from the current depth
-      }
-      break;
+    // Keep the best line first unless the iteration was cut short
+    if (!stop_search_) {
+      std::stable_sort(lines_.begin(), lines_.end(),
+                       [](const SearchLine &a, const SearchLine &b) {
+                         return a.score > b.score;
+                       });
     }
-
-    // Update the PV line and score
-    for (int i = 0; i < new_pv_line.count; i++) {
-      pv_line_.moves[i] = new_pv_line.moves[i];
-    }
-    pv_line_.count = new_pv_line.count;
-    score = temp_score;
-
-    // Update the alpha and beta values for the aspiration window
-    alpha = temp_score - kAspirationWindow;
-    beta = temp_score + kAspirationWindow;
+    pv_line_ = lines_[0].pv_line;
+    score = lines_[0].score;
+    if (stop_search_) break;
 
     // Print the search info
-    PrintSearchInfo(&pv_line_, position);
+    PrintSearchInfo(position);
     printed_info = true;
+    if constexpr (kCollectSearchStats) {
+      if (print_info_) PrintIterationStats();
+    }
 
     // Check if we have a checkmate score, if so then we can stop searching
     if ((score > kCheckmateScore && score < kCheckmateWindow) ||
@@ -111,15 +104,247 @@ void SearchEngine::Search(Position &position) {
       break;
     }
 
+    if (timed_search_) {
+      time_manager_.Update(GetTime(), pv_line_.moves[0], score,
+                           BestMoveNodeShare());
+    }
+
     current_depth_++;  // Increment the depth
     CheckStop();       // Check if we should stop the search
+
+    // Do not start an iteration that is unlikely to finish in time
+    if (!stop_search_ && timed_search_ && !ponder_search_ &&
+        !time_manager_.ShouldStartIteration(GetTime())) {
+      stop_search_ = true;
+    }
   } while (!stop_search_);
 
+  // Report how long it took to unwind the search after the deadline passed
+  if (stop_timer_.Expired() && print_info_) {
+    std::cout << "info string stop latency "
+              << GetTimeMicroseconds() - end_time_ * 1000 << " us"
+              << std::endl;
+  }
+  stop_timer_.Disarm();
+
   if (!printed_info) {
-    PrintSearchInfo(&pv_line_, position);
+    PrintSearchInfo(position);
+  }
+
+  // The best move must not be sent while pondering, so wait for the opponent
+  // to play the expected move or for the search to be stopped
+  while (pondering_ && !external_stop_) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  if (!print_info_) return;
+  std::cout << "bestmove " << move::ToString(pv_line_.moves[0]);
+  move::Move ponder_move = GetPonderMove(position);
+  if (ponder_move != 0) {
+    std::cout << " ponder " << move::ToString(ponder_move);
+  }
+  std::cout << std::endl;
+}
+
+move::Move SearchEngine::GetPonderMove(Position &position) {
+  if (pv_line_.count == 0) return 0;
+  if (pv_line_.count > 1) return pv_line_.moves[1];
+
+  // The PV was cut short, so use the transposition table move of the position
+  // after the best move if it is legal
+  PositionState state = position.GetState();
+  if (!position.MakeMove(pv_line_.moves[0], false)) return 0;
+  move::Move ponder_move = 0;
+  TTEntry tt_entry = position.transposition_table_.Get(position.state_.key);
+  if (tt_entry.key == position.state_.key && tt_entry.bestMove != 0) {
+    move::MoveList moves;
+    GenerateMoves(position, moves);
+    PositionState child_state = position.GetState();
+    for (move::Move move : moves) {
+      if (move != tt_entry.bestMove) continue;
+      if (position.MakeMove(move, false)) ponder_move = move;
+      position.SetState(child_state);
+      break;
+    }
+  }
+  position.SetState(state);
+  return ponder_move;
+}
+
+void SearchEngine::SearchCurrentLine(Position &position) {
+  SearchLine &line = lines_[pv_index_];
+  pv_line_ = line.pv_line;
+  score = line.score;
+  previous_score_ = line.previous_score;
+
+  // Perform aspiration window search
+  PvLine new_pv_line;
+  int temp_score = AspirationSearch(position, &new_pv_line);
+
+  // If the search was stopped, check if we should use the new PV line
+  if (stop_search_) {
+    // Lines after the first keep their result from the previous iteration
+    if (pv_index_ > 0) return;
+
+    // If the new PV line has the same first move then it is a more accurate
+    // evaluation so we should use it
+    if (new_pv_line.count == 0) {
+      // A PV line was not found so the old one is the best we have
+      current_depth_--;
+    } else if (new_pv_line.moves[0] == line.pv_line.moves[0]) {
+      line.score = temp_score;
+      line.pv_line = new_pv_line;
+    } else if (temp_score > line.score) {
+      // If the new PV line is better than the old one then we should use it
+      line.score = temp_score;
+      line.pv_line = new_pv_line;
+    } else {
+      // Otherwise we cannot trust the new PV line so we should just use the
+      // old one
+      current_depth_--;  // Decrement the depth because we didn't find any new
+                         // info from the current depth
+    }
+    return;
+  }
+
+  // Update the PV line and score
+  line.pv_line = new_pv_line;
+  line.previous_score = line.score;
+  line.score = temp_score;
+}
+
+void SearchEngine::InitRootMoves(Position &position) {
+  move::MoveList moves;
+  GenerateMoves(position, moves);
+
+  // Order the moves for the first iteration like any other node
+  ply = 0;
+  pv_line_ = PvLine();
+  TTEntry tt_entry = position.transposition_table_.Get(position.state_.key);
+  tt_move_ = tt_entry.key == position.state_.key ? tt_entry.bestMove : 0;
+  SortMoves(moves, position);
+
+  root_moves_.clear();
+  PositionState state;
+  for (move::Move move : moves) {
+    state = position.GetState();
+    if (!position.MakeMove(move, false)) continue;
+    position.SetState(state);
+
+    bool searched = search_moves_.empty() ||
+                    std::find(search_moves_.begin(), search_moves_.end(),
+                              move) != search_moves_.end();
+    if (searched) {
+      RootMove root_move;
+      root_move.move = move;
+      root_moves_.push_back(root_move);
+    }
+  }
+
+  // If none of the search moves are legal, search all moves
+  if (root_moves_.empty() && !search_moves_.empty()) {
+    search_moves_.clear();
+    InitRootMoves(position);
+  }
+}
+
+void SearchEngine::SortRootMoves() {
+  for (RootMove &root_move : root_moves_) {
+    root_move.previous_nodes = root_move.nodes;
+    root_move.previous_score = root_move.score;
+    root_move.nodes = 0;
+    root_move.score = -kInfinity;
+  }
+
+  // Returns the index of the line that starts with the move, or the number of
+  // lines if there is none
+  auto line_index = [this](move::Move move) {
+    int index = 0;
+    while (index < static_cast<int>(lines_.size()) &&
+           lines_[index].pv_line.moves[0] != move) {
+      index++;
+    }
+    return index;
+  };
+
+  std::stable_sort(root_moves_.begin(), root_moves_.end(),
+                   [&line_index](const RootMove &a, const RootMove &b) {
+                     int a_line = line_index(a.move);
+                     int b_line = line_index(b.move);
+                     if (a_line != b_line) return a_line < b_line;
+                     // Moves with an exact score beat the moves that were
+                     // only proven worse than alpha
+                     if (a.previous_score != b.previous_score) {
+                       return a.previous_score > b.previous_score;
+                     }
+                     return a.previous_nodes > b.previous_nodes;
+                   });
+}
+
+SearchEngine::RootMove *SearchEngine::FindRootMove(move::Move move) {
+  for (RootMove &root_move : root_moves_) {
+    if (root_move.move == move) return &root_move;
   }
+  return nullptr;
+}
 
-  std::cout << "bestmove " << move::ToString(pv_line_.moves[0]) << std::endl;
+int SearchEngine::BestMoveNodeShare() {
+  uint64_t total_nodes = 0;
+  uint64_t best_move_nodes = 0;
+  for (const RootMove &root_move : root_moves_) {
+    total_nodes += root_move.nodes;
+    if (root_move.move == pv_line_.moves[0]) best_move_nodes = root_move.nodes;
+  }
+  if (total_nodes == 0) return 100;
+  return (best_move_nodes * 100) / total_nodes;
+}
+
+bool SearchEngine::IsExcludedRootMove(move::Move move) const {
+  for (int i = 0; i < pv_index_; i++) {
+    if (lines_[i].pv_line.moves[0] == move) return true;
+  }
+  return false;
+}
+
+int SearchEngine::AspirationSearch(Position &position, PvLine *pv_line) {
+  int alpha = -kInfinity;
+  int beta = kInfinity;
+
+  // Size the window by how much the score moved in the last iteration
+  int delta = kAspirationWindow;
+  bool use_window = current_depth_ >= kAspirationMinDepth &&
+                    score != kUnknownScore && std::abs(score) < -kCheckmateWindow;
+  if (use_window) {
+    if (previous_score_ != kUnknownScore) {
+      delta += std::abs(score - previous_score_) / 2;
+    }
+    alpha = std::max(score - delta, -kInfinity);
+    beta = std::min(score + delta, kInfinity);
+  }
+
+  int researches = 0;
+  while (true) {
+    int result = Negamax(alpha, beta, current_depth_, position, pv_line,
+                         kPvNode, false);
+    if (stop_search_) return result;
+
+    // Widen only the side of the window that failed, growing geometrically
+    if (result <= alpha) {
+      alpha = std::max(result - delta, -kInfinity);
+    } else if (result >= beta) {
+      beta = std::min(result + delta, kInfinity);
+    } else {
+      if (researches > 0 && print_info_) {
+        std::cout << "info string depth " << current_depth_
+                  << " aspiration re-searches " << researches << " total "
+                  << aspiration_researches_ << std::endl;
+      }
+      return result;
+    }
+    delta += delta / 2;
+    researches++;
+    aspiration_researches_++;
+  }
 }
 
 void SearchEngine::ResetSearchParameters() {
@@ -133,34 +358,65 @@ void SearchEngine::ResetSearchParameters() {
   white_inc_ = 0;
   black_inc_ = 0;
   moves_to_go_ = 0;
+  move_time_ = 0;
+  search_moves_.clear();
   engine_decides_search_params_ = false;
 }
 
+void SearchEngine::ClearHistory() {
+  memset(killer_moves_, 0, sizeof(killer_moves_));
+  memset(history_moves_, 0, sizeof(history_moves_));
+  memset(counter_moves_, 0, sizeof(counter_moves_));
+  memset(move_stack_, 0, sizeof(move_stack_));
+  memset(capture_history_, 0, sizeof(capture_history_));
+  continuation_history_[0].Clear();
+  continuation_history_[1].Clear();
+}
+
 int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
-                          PvLine *pv_line, bool is_null) {
-  if (nodes % kCheckupFrequency == 0) CheckStop();
+                          PvLine *pv_line, NodeType node_type, bool is_null) {
+  PollStop();
 
   nodes++;
+  if constexpr (kCollectSearchStats) {
+    stats_.main_nodes++;
+    stats_.seldepth = std::max(stats_.seldepth, ply);
+    stats_.tt_probes++;
+  }
 
-  // Probe the transposition table
+  // Probe the transposition table. The best move is used for move ordering
+  // even if the entry is not deep enough to cut off. The root never cuts off
+  // because it must always produce a PV line.
+  move::Move tt_move = 0;
   TTEntry tt_entry = position.transposition_table_.Get(position.state_.key);
-  if (tt_entry.key == position.state_.key && tt_entry.depth >= depth) {
-    if (tt_entry.flags == kAlphaHashFlag && tt_entry.score <= alpha) {
-      return alpha;
-    } else if (tt_entry.flags == kBetaHashFlag && tt_entry.score >= beta) {
-      return beta;
-    } else {
-      tt_move_ = tt_entry.bestMove;
+  if (tt_entry.key == position.state_.key) {
+    if constexpr (kCollectSearchStats) stats_.tt_hits++;
+    if (ply > 0 && tt_entry.depth >= depth) {
+      if (tt_entry.flags == kAlphaHashFlag && tt_entry.score <= alpha) {
+        if constexpr (kCollectSearchStats) stats_.tt_cutoffs++;
+        return alpha;
+      } else if (tt_entry.flags == kBetaHashFlag && tt_entry.score >= beta) {
+        if constexpr (kCollectSearchStats) stats_.tt_cutoffs++;
+        return beta;
+      }
     }
-  } else {
-    tt_move_ = 0;
+    tt_move = tt_entry.bestMove;
   }
 
   // Check for draw
-  if (ply > 0 && position.repetition_table_.HasRepetition(position.state_.key))
+  if (ply > 0 && position.repetition_table_.HasRepetition(
+                     position.state_.key,
+                     std::min(position.state_.halfmove_clock,
+                              position.state_.plies_from_null)))
     return kDrawScore;
   if (position.state_.halfmove_clock >= 100) return kDrawScore;
 
+  // If a move repeats an earlier position the score is at least a draw
+  if (alpha < kDrawScore && position.HasUpcomingRepetition(ply)) {
+    alpha = kDrawScore;
+    if (alpha >= beta) return alpha;
+  }
+
   // Extend the search if in check
   bool in_check = IsInCheck(position);
   if (in_check) depth++;
@@ -174,15 +430,29 @@ int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
     return score;
   }
 
-  // Null move pruning
+  // Null move pruning. If passing still fails high, a real move almost
+  // certainly does too. Only tried at non-PV nodes when the static eval is
+  // already above beta and the side to move has pieces, since zugzwang is
+  // common with only pawns.
+  // Verified cutoffs disable null moves for the same side for a few plies.
+  int static_eval =
+      in_check ? -kInfinity : Evaluate(position, eval_tables_);
+  Color side = position.state_.side_to_move;
   bool null_move_allowed =
-      (depth > (1 + kNullMoveReductionAmount)) && !in_check && !is_null;
-  if (null_move_allowed) {
-    null_move_allowed =
-        position.GetNumNonPawnKingPieces(kBothColors) > kEndgamePieceCount;
-  }
+      node_type != kPvNode && depth >= kNullMoveMinDepth && !in_check &&
+      !is_null &&
+      static_eval >= beta && beta < -kCheckmateWindow &&
+      (ply >= null_move_min_ply_ || side != null_move_color_) &&
+      position.GetNumNonPawnKingPieces(side) > 0;
   if (null_move_allowed) {
+    // Reduce more at high depth and when the eval is far above beta
+    int reduction =
+        kNullMoveBaseReduction + depth / kNullMoveDepthDivisor +
+        std::min((static_eval - beta) / kNullMoveEvalMargin,
+                 kNullMoveMaxEvalReduction);
+
     PositionState state = position.GetState();
+    move_stack_[ply] = 0;
     ply++;
     position.repetition_table_.Add(state.key);
     if (position.state_.en_passant_square != kNoSquare) {
@@ -192,9 +462,12 @@ int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
     }
     position.state_.side_to_move = ~position.state_.side_to_move;
     position.state_.key ^= zobrist::side_key;
+    position.state_.plies_from_null = 0;
 
-    int score = -Negamax(-beta, -beta + 1, depth - 1 - kNullMoveReductionAmount,
-                         position, pv_line, true);
+    if constexpr (kCollectSearchStats) stats_.null_move_searches++;
+    PvLine null_pv_line;
+    int score = -Negamax(-beta, -beta + 1, depth - 1 - reduction, position,
+                         &null_pv_line, ZeroWindowChild(node_type), true);
     ply--;
     position.repetition_table_.RemoveLast();
     position.SetState(state);
@@ -202,16 +475,140 @@ int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
       return alpha;
     }
     if (score >= beta) {
-      position.transposition_table_.Store(position.state_.key, depth,
-                                          kBetaHashFlag, beta, 0);
-      return beta;
+      // At high depth, search the node itself at the reduced depth without
+      // null moves to catch zugzwang positions
+      bool verified = true;
+      if (depth >= kNullMoveVerificationDepth && null_move_min_ply_ == 0) {
+        null_move_min_ply_ = ply + (3 * (depth - 1 - reduction)) / 4;
+        null_move_color_ = side;
+        PvLine verification_pv_line;
+        int verification_score =
+            Negamax(beta - 1, beta, depth - 1 - reduction, position,
+                    &verification_pv_line, node_type, false);
+        null_move_min_ply_ = 0;
+        if (stop_search_) return alpha;
+        verified = verification_score >= beta;
+      }
+      if (verified) {
+        if constexpr (kCollectSearchStats) stats_.null_move_cutoffs++;
+        position.transposition_table_.Store(position.state_.key, depth,
+                                            kBetaHashFlag, beta, 0);
+        return beta;
+      }
     }
   }
 
-  // Generate moves
+  // Generate moves. The root searches its root moves in their own order.
   move::MoveList moves;
-  GenerateMoves(position, moves);
-  SortMoves(moves, position);
+  if (ply == 0) {
+    for (const RootMove &root_move : root_moves_) {
+      moves.push_back(root_move.move);
+    }
+  } else {
+    GenerateMoves(position, moves);
+    tt_move_ = tt_move;
+    SortMoves(moves, position);
+  }
+
+  // ProbCut. At a non-PV node, a capture that beats beta by a wide margin at a
+  // reduced depth almost certainly beats beta at full depth, so the node can
+  // be cut. Skipped if the transposition table already says the node is below
+  // the raised beta at a similar depth.
+  int probcut_beta = beta + kProbCutMargin;
+  int probcut_depth = depth - kProbCutDepthReduction;
+  bool probcut_allowed =
+      node_type != kPvNode && depth >= kProbCutMinDepth && !in_check &&
+      std::abs(beta) < -kCheckmateWindow &&
+      !(tt_entry.key == position.state_.key &&
+        tt_entry.depth >= probcut_depth + 1 && tt_entry.score < probcut_beta);
+  if (probcut_allowed) {
+    for (move::Move move : moves) {
+      // Only try captures that win enough material to reach the raised beta
+      if (!move::IsCapture(move)) continue;
+      if (!StaticExchangeAtLeast(position, move, probcut_beta - static_eval)) {
+        continue;
+      }
+
+      PositionState probcut_state = position.GetState();
+      move_stack_[ply] = move;
+      ply++;
+      position.repetition_table_.Add(probcut_state.key);
+      if (!position.MakeMove(move, false)) {
+        ply--;
+        position.repetition_table_.RemoveLast();
+        continue;
+      }
+
+      // A quiescence search is much cheaper and filters out most captures
+      // before the reduced search
+      if constexpr (kCollectSearchStats) stats_.probcut_searches++;
+      int score = -Quiescence(-probcut_beta, -probcut_beta + 1, position);
+      if (score >= probcut_beta && !stop_search_) {
+        PvLine probcut_pv_line;
+        score = -Negamax(-probcut_beta, -probcut_beta + 1, probcut_depth,
+                         position, &probcut_pv_line, ZeroWindowChild(node_type),
+                         false);
+      }
+
+      ply--;
+      position.repetition_table_.RemoveLast();
+      position.SetState(probcut_state);
+      if (stop_search_) return alpha;
+
+      if (score >= probcut_beta) {
+        if constexpr (kCollectSearchStats) stats_.probcut_cutoffs++;
+        position.transposition_table_.Store(position.state_.key,
+                                            probcut_depth + 1, kBetaHashFlag,
+                                            beta, move);
+        return beta;
+      }
+    }
+  }
+
+  // Multi-cut. A node that is expected to fail high is cut if several of its
+  // first moves already beat beta at a reduced depth, since it is then very
+  // likely that at least one of them does so at full depth.
+  bool multicut_allowed = node_type == kCutNode &&
+                          depth >= kMultiCutMinDepth && !in_check &&
+                          std::abs(beta) < -kCheckmateWindow;
+  if (multicut_allowed) {
+    if constexpr (kCollectSearchStats) stats_.multicut_searches++;
+    int tried = 0;
+    int cutoffs = 0;
+    for (move::Move move : moves) {
+      if (tried >= kMultiCutMoves) break;
+
+      PositionState multicut_state = position.GetState();
+      move_stack_[ply] = move;
+      ply++;
+      position.repetition_table_.Add(multicut_state.key);
+      if (!position.MakeMove(move, false)) {
+        ply--;
+        position.repetition_table_.RemoveLast();
+        continue;
+      }
+
+      tried++;
+      PvLine multicut_pv_line;
+      int score = -Negamax(-beta, -beta + 1, depth - 1 - kMultiCutReduction,
+                           position, &multicut_pv_line, kAllNode, false);
+
+      ply--;
+      position.repetition_table_.RemoveLast();
+      position.SetState(multicut_state);
+      if (stop_search_) return alpha;
+
+      if (score >= beta && ++cutoffs >= kMultiCutRequired) {
+        if constexpr (kCollectSearchStats) stats_.multicut_cutoffs++;
+        position.transposition_table_.Store(position.state_.key,
+                                            depth - kMultiCutReduction,
+                                            kBetaHashFlag, beta, move);
+        return beta;
+      }
+      // Stop early once the remaining moves can no longer reach the count
+      if (cutoffs + kMultiCutMoves - tried < kMultiCutRequired) break;
+    }
+  }
 
   PositionState state;
   PvLine new_pv_line;
@@ -219,10 +616,19 @@ int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
 
   int legal_moves = 0;
   int moves_searched = 0;
+  move::Move quiets_searched[kMaxQuietsSearched];
+  int num_quiets_searched = 0;
+  move::Move captures_searched[kMaxCapturesSearched];
+  int num_captures_searched = 0;
 
   // loop through moves
   for (move::Move move : moves) {
+    // Skip root moves that are the first move of an earlier MultiPV line
+    if (ply == 0 && pv_index_ > 0 && IsExcludedRootMove(move)) continue;
+
+    uint64_t nodes_before_move = nodes;
     state = position.GetState();
+    move_stack_[ply] = move;
     ply++;
     position.repetition_table_.Add(state.key);
 
@@ -236,16 +642,26 @@ int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
     legal_moves++;
     int score;
 
-    // Always do a full depth search on the first few moves
+    // Always do a full depth search on the first few moves. The window of a
+    // non-PV node is already zero, so its children keep alternating between
+    // cut and all nodes.
+    NodeType child_type =
+        node_type == kPvNode ? kPvNode : ZeroWindowChild(node_type);
     if (moves_searched < kMinimumFullDepthSearches) {
-      score = -Negamax(-beta, -alpha, depth - 1, position, &new_pv_line, false);
+      score = -Negamax(-beta, -alpha, depth - 1, position, &new_pv_line,
+                       child_type, false);
     } else {  // Otherwise try to reduce the search
       // Check if we can use LMR
       if (moves_searched >= kLmrFullDepthMoves && depth >= kLmrReductionLimit &&
           CanDoLMR(move, position)) {
         // If we can use LMR, do a reduced depth PVS search
         score = -Negamax(-alpha - 1, -alpha, depth - 1 - kLmrReductionAmount,
-                         position, &new_pv_line, false);
+                         position, &new_pv_line, ZeroWindowChild(node_type),
+                         false);
+        if constexpr (kCollectSearchStats) {
+          stats_.lmr_searches++;
+          if (score > alpha) stats_.lmr_researches++;
+        }
       } else {
         // If we can't use LMR, do a full PVS search
         score = alpha + 1;
@@ -254,12 +670,13 @@ int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
       if (score > alpha) {
         // Do a full PVS search
         score = -Negamax(-alpha - 1, -alpha, depth - 1, position, &new_pv_line,
-                         false);
+                         ZeroWindowChild(node_type), false);
 
-        // If the score is in the window, do a full search
+        // If the score is in the window, do a full search. This can only
+        // happen at a PV node.
         if (score > alpha && score < beta) {
-          score =
-              -Negamax(-beta, -alpha, depth - 1, position, &new_pv_line, false);
+          score = -Negamax(-beta, -alpha, depth - 1, position, &new_pv_line,
+                           kPvNode, false);
         }
       }
     }
@@ -272,32 +689,43 @@ int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
     // and we should just return
     if (stop_search_) return alpha;
 
+    if (ply == 0) {
+      RootMove *root_move = FindRootMove(move);
+      root_move->nodes += nodes - nodes_before_move;
+      root_move->score = score > alpha ? score : -kInfinity;
+    }
+
     moves_searched++;
+    bool is_quiet =
+        !move::IsCapture(move) && move::GetPromotedPiece(move) == kNoPiece;
 
     // Check if the score fails high
     if (score >= beta) {
-      // If it is a quiet move, add it to the killer moves
-      if (!move::IsCapture(move) && move::GetPromotedPiece(move) == kNoPiece) {
-        for (int i = kNumKillerMoves - 1; i > 0; i--) {
-          killer_moves_[current_depth_][i] =
-              killer_moves_[current_depth_][i - 1];
-        }
-        killer_moves_[current_depth_][0] = move;
+      if constexpr (kCollectSearchStats) {
+        stats_.fail_highs++;
+        if (moves_searched == 1) stats_.first_move_fail_highs++;
       }
+      // If it is a quiet move, update the killers, counter moves and histories
+      if (is_quiet) {
+        UpdateQuietCutoff(move, depth, quiets_searched, num_quiets_searched);
+      }
+      UpdateCaptureCutoff(move, depth, position, captures_searched,
+                          num_captures_searched);
       position.transposition_table_.Store(position.state_.key, depth,
                                           kBetaHashFlag, beta, move);
       return beta;
     }
 
+    // Remember the quiet moves that failed to cut off so they can be penalized
+    if (is_quiet && num_quiets_searched < kMaxQuietsSearched) {
+      quiets_searched[num_quiets_searched++] = move;
+    }
+    if (move::IsCapture(move) && num_captures_searched < kMaxCapturesSearched) {
+      captures_searched[num_captures_searched++] = move;
+    }
+
     // Check if the score is better than alpha
     if (score > alpha) {
-      // If it is a quiet move and not a promotion, add it to the history
-      // moves
-      if (!move::IsCapture(move) && move::GetPromotedPiece(move) == kNoPiece) {
-        history_moves_[position.PieceOn(move::GetSourceSquare(move))]
-                      [move::GetTargetSquare(move)] += depth * depth;
-      }
-
       // Update the PV line
       pv_line->moves[0] = move;
       for (int i = 0; i < new_pv_line.count; i++) {
@@ -325,16 +753,28 @@ int SearchEngine::Negamax(int alpha, int beta, int depth, Position &position,
 }
 
 int SearchEngine::Quiescence(int alpha, int beta, Position &position) {
-  if (nodes % kCheckupFrequency == 0) CheckStop();
+  PollStop();
 
   nodes++;
+  if constexpr (kCollectSearchStats) {
+    stats_.qsearch_nodes++;
+    stats_.seldepth = std::max(stats_.seldepth, ply);
+  }
 
   // Check for draw
-  if (ply > 0 && position.repetition_table_.HasRepetition(position.state_.key))
+  if (ply > 0 && position.repetition_table_.HasRepetition(
+                     position.state_.key,
+                     std::min(position.state_.halfmove_clock,
+                              position.state_.plies_from_null)))
     return kDrawScore;
   if (position.state_.halfmove_clock >= 100) return kDrawScore;
 
-  int evaluation = Evaluate(position);
+  // Check for max depth reached
+  if (ply > kMaxSearchDepth - 1) return Evaluate(position, eval_tables_);
+
+  // Only whether the stand pat score is outside the window matters when it is
+  // far outside, so the evaluation can be lazy
+  int evaluation = Evaluate(position, eval_tables_, alpha, beta);
 
   if (evaluation >= beta) return beta;
   if (evaluation > alpha) alpha = evaluation;
@@ -345,10 +785,12 @@ int SearchEngine::Quiescence(int alpha, int beta, Position &position) {
   SortMoves(moves, position);
 
   PositionState state;
+  int moves_searched = 0;
 
   // loop through moves
   for (move::Move move : moves) {
     state = position.GetState();
+    move_stack_[ply] = move;
     ply++;
     position.repetition_table_.Add(state.key);
 
@@ -370,8 +812,15 @@ int SearchEngine::Quiescence(int alpha, int beta, Position &position) {
     // and we should just return
     if (stop_search_) return alpha;
 
-    if (score >= beta) return beta;
+    if (score >= beta) {
+      if constexpr (kCollectSearchStats) {
+        stats_.qsearch_cutoffs++;
+        if (moves_searched == 0) stats_.qsearch_first_move_cutoffs++;
+      }
+      return beta;
+    }
     if (score > alpha) alpha = score;
+    moves_searched++;
   }
 
   return alpha;
@@ -379,38 +828,129 @@ int SearchEngine::Quiescence(int alpha, int beta, Position &position) {
 
 bool SearchEngine::ShouldStop() {
   if (external_stop_) return true;
+  if (pondering_) return current_depth_ > kMaxSearchDepth;
   if (max_nodes_ != 0 && nodes >= max_nodes_) return true;
   if (search_depth_ != -1 && current_depth_ > search_depth_) return true;
-  if (end_time_ != 0 && GetTime() >= end_time_) return true;
+  if (stop_timer_.Expired()) return true;
   if (current_depth_ > kMaxSearchDepth) return true;
   return false;
 }
 
-void SearchEngine::CheckStop() { stop_search_ = ShouldStop(); }
+void SearchEngine::CheckStop() {
+  // Start the clock when a ponder search becomes a normal search
+  if (ponder_search_ && !pondering_) {
+    ponder_search_ = false;
+    if (timed_search_) {
+      time_manager_.Restart(GetTime());
+      end_time_ = time_manager_.GetHardDeadline();
+      stop_timer_.Arm(end_time_);
+    }
+  }
+  stop_search_ = ShouldStop();
+}
 
 int SearchEngine::ScoreMove(move::Move move, Position &position) {
-  if (move == pv_line_.moves[ply]) return 100000;
+  if (move == pv_line_.moves[ply]) return kPvMoveScore;
 
-  if (move == tt_move_) return 90000;
+  if (move == tt_move_) return kTTMoveScore;
 
   if (move::IsCapture(move)) {
-    Piece target_piece = position.PieceOn(move::GetTargetSquare(move));
-    Piece piece = position.PieceOn(move::GetSourceSquare(move));
-    return kMvvLvaScores[piece][target_piece] + 10000;
+    Piece piece = move::GetPiece(move);
+    Piece target_piece = move::IsEnPassant(move)
+                             ? GetPiece(kPawn, ~GetPieceColor(piece))
+                             : position.PieceOn(move::GetTargetSquare(move));
+    return kCaptureScore + kMvvLvaScores[piece][target_piece] +
+           CaptureHistory(move, position) / kCaptureHistoryDivisor;
   }
 
   for (int i = 0; i < kNumKillerMoves; i++) {
-    if (move == killer_moves_[current_depth_][i]) {
-      return 9000 - i;
+    if (move == killer_moves_[ply][i]) {
+      return kKillerMoveScore - i;
     }
   }
 
+  move::Move previous_move = PreviousMove(1);
+  if (previous_move != 0 &&
+      move == counter_moves_[move::GetPiece(previous_move)]
+                            [move::GetTargetSquare(previous_move)]) {
+    return kCounterMoveScore;
+  }
+
   if (move::GetPromotedPiece(move) != kNoPiece) {
-    return 8000 + move::GetPromotedPiece(move);
+    return kPromotionScore + move::GetPromotedPiece(move);
   }
 
-  return history_moves_[position.PieceOn(move::GetSourceSquare(move))]
-                       [move::GetTargetSquare(move)];
+  return QuietHistoryScore(move);
+}
+
+int SearchEngine::QuietHistoryScore(move::Move move) const {
+  Piece piece = move::GetPiece(move);
+  Square target = move::GetTargetSquare(move);
+  int score = history_moves_[piece][target];
+
+  for (int i = 0; i < 2; i++) {
+    move::Move previous_move = PreviousMove(i + 1);
+    if (previous_move == 0) continue;
+    score += continuation_history_[i].Get(move::GetPiece(previous_move),
+                                          move::GetTargetSquare(previous_move),
+                                          piece, target);
+  }
+
+  return score;
+}
+
+void SearchEngine::UpdateQuietHistories(move::Move move, int bonus) {
+  Piece piece = move::GetPiece(move);
+  Square target = move::GetTargetSquare(move);
+  UpdateHistory(history_moves_[piece][target], bonus);
+
+  for (int i = 0; i < 2; i++) {
+    move::Move previous_move = PreviousMove(i + 1);
+    if (previous_move == 0) continue;
+    UpdateHistory(continuation_history_[i].Get(
+                      move::GetPiece(previous_move),
+                      move::GetTargetSquare(previous_move), piece, target),
+                  bonus);
+  }
+}
+
+void SearchEngine::UpdateQuietCutoff(move::Move move, int depth,
+                                     const move::Move *quiets_searched,
+                                     int num_quiets_searched) {
+  // Add the move to the killer moves
+  if (killer_moves_[ply][0] != move) {
+    for (int i = kNumKillerMoves - 1; i > 0; i--) {
+      killer_moves_[ply][i] = killer_moves_[ply][i - 1];
+    }
+    killer_moves_[ply][0] = move;
+  }
+
+  // Store the move as the counter to the previous move
+  move::Move previous_move = PreviousMove(1);
+  if (previous_move != 0) {
+    counter_moves_[move::GetPiece(previous_move)]
+                  [move::GetTargetSquare(previous_move)] = move;
+  }
+
+  // Reward the cutoff move and penalize the quiet moves that failed to cut off
+  int bonus = HistoryBonus(depth);
+  UpdateQuietHistories(move, bonus);
+  for (int i = 0; i < num_quiets_searched; i++) {
+    UpdateQuietHistories(quiets_searched[i], -bonus);
+  }
+}
+
+void SearchEngine::UpdateCaptureCutoff(move::Move move, int depth,
+                                       Position &position,
+                                       const move::Move *captures_searched,
+                                       int num_captures_searched) {
+  int bonus = HistoryBonus(depth);
+  if (move::IsCapture(move)) {
+    UpdateHistory(CaptureHistory(move, position), bonus);
+  }
+  for (int i = 0; i < num_captures_searched; i++) {
+    UpdateHistory(CaptureHistory(captures_searched[i], position), -bonus);
+  }
 }
 
 void SearchEngine::SortMoves(move::MoveList &moves, Position &position) {
@@ -439,30 +979,64 @@ bool SearchEngine::CanDoLMR(move::Move move, Position &position) {
   return true;
 }
 
-void SearchEngine::PrintSearchInfo(PvLine *pv_line, Position &position) {
-  if (score > kCheckmateScore && score < kCheckmateWindow) {
-    std::cout << "info score mate " << (score - kCheckmateScore + 1) / -2;
-    std::cout << " depth " << current_depth_;
-    std::cout << " nodes " << nodes;
-    std::cout << " time " << (GetTime() - start_time_);
-    std::cout << " nps " << (nodes * 1000) / (GetTime() - start_time_);
-    std::cout << " hashfull " << position.transposition_table_.GetFullPercentage();
-  } else if (score > -kCheckmateWindow && score < -kCheckmateScore) {
-    std::cout << "info score mate "
-              << std::abs(score + kCheckmateScore - 1) / 2;
-    std::cout << " depth " << current_depth_;
-    std::cout << " nodes " << nodes;
-    std::cout << " time " << (GetTime() - start_time_);
-    std::cout << " nps " << (nodes * 1000) / (GetTime() - start_time_);
-    std::cout << " hashfull " << position.transposition_table_.GetFullPercentage();
+void SearchEngine::CollectPawnHashStats() {
+  stats_.pawn_hash_probes = eval_tables_.pawn_table.probes_;
+  stats_.pawn_hash_hits = eval_tables_.pawn_table.hits_;
+  stats_.lazy_evals = eval_tables_.lazy_evals;
+}
+
+void SearchEngine::PrintIterationStats() {
+  CollectPawnHashStats();
+  SearchStats iteration = stats_.Since(iteration_start_stats_);
+  uint64_t iteration_nodes = iteration.main_nodes + iteration.qsearch_nodes;
+
+  // The effective branching factor compares the cost of this iteration with
+  // the previous one
+  uint64_t branching_factor =
+      previous_iteration_nodes_ == 0
+          ? 0
+          : (iteration_nodes * 100) / previous_iteration_nodes_;
+  iteration.Print(std::cout, "depth " + std::to_string(current_depth_),
+                  branching_factor);
+
+  iteration_start_stats_ = stats_;
+  previous_iteration_nodes_ = iteration_nodes;
+}
+
+void SearchEngine::PrintStats() {
+  if (!kCollectSearchStats) {
+    std::cout << "info string stats are disabled, build with make STATS=1"
+              << std::endl;
+    return;
+  }
+  CollectPawnHashStats();
+  stats_.Print(std::cout, "total", 0);
+}
+
+void SearchEngine::PrintSearchInfo(Position &position) {
+  if (!print_info_) return;
+  for (int i = 0; i < static_cast<int>(lines_.size()); i++) {
+    PrintSearchInfo(&lines_[i].pv_line, lines_[i].score, i + 1, position);
+  }
+}
+
+void SearchEngine::PrintSearchInfo(PvLine *pv_line, int line_score,
+                                   int multipv, Position &position) {
+  std::cout << "info";
+  if (multi_pv_ > 1) std::cout << " multipv " << multipv;
+  if (line_score > kCheckmateScore && line_score < kCheckmateWindow) {
+    std::cout << " score mate " << (line_score - kCheckmateScore + 1) / -2;
+  } else if (line_score > -kCheckmateWindow && line_score < -kCheckmateScore) {
+    std::cout << " score mate "
+              << std::abs(line_score + kCheckmateScore - 1) / 2;
   } else {
-    std::cout << "info score cp " << score;
-    std::cout << " depth " << current_depth_;
-    std::cout << " nodes " << nodes;
-    std::cout << " time " << (GetTime() - start_time_);
-    std::cout << " nps " << (nodes * 1000) / (GetTime() - start_time_);
-    std::cout << " hashfull " << position.transposition_table_.GetFullPercentage();
+    std::cout << " score cp " << line_score;
   }
+  std::cout << " depth " << current_depth_;
+  std::cout << " nodes " << nodes;
+  std::cout << " time " << (GetTime() - start_time_);
+  std::cout << " nps " << (nodes * 1000) / (GetTime() - start_time_);
+  std::cout << " hashfull " << position.transposition_table_.GetFullPercentage();
   std::cout << " pv ";
   for (int count = 0; count < pv_line->count; count++) {
     std::cout << move::ToString(pv_line->moves[count]) << " ";
@@ -470,4 +1044,4 @@ void SearchEngine::PrintSearchInfo(PvLine *pv_line, Position &position) {
   std::cout << std::endl;
 }
 
-}  // namespace chess
\ No newline at end of file
+}  // namespace chess
@@ -4,12 +4,33 @@
 
 #include <cstdint>
 #include <atomic>
+#include <vector>
 
+#include "history.hpp"
+#include "evaluator.hpp"
 #include "utils.hpp"
 #include "position.hpp"
+#include "search_stats.hpp"
+#include "stop_timer.hpp"
+#include "time_manager.hpp"
 
 namespace chess {
 
+// The expected type of a node in the search tree. A PV node is searched with
+// an open window and its score is expected to fall inside it. A cut node is
+// expected to fail high, usually on its first move, and an all node is
+// expected to fail low after searching every move.
+enum NodeType { kPvNode, kCutNode, kAllNode };
+
+// Returns the expected type of a child that is searched with a zero window.
+// The children of a cut node are all nodes and the other way around, and the
+// zero window children of a PV node are expected to be refuted.
+// @param node_type The type of the parent node.
+// @return The type of the child node.
+constexpr NodeType ZeroWindowChild(NodeType node_type) {
+  return node_type == kCutNode ? kAllNode : kCutNode;
+}
+
 class SearchEngine {
  public:
 
@@ -18,15 +39,81 @@ class SearchEngine {
     int count = 0;
  };
 
+ // A legal root move and what the search has learned about it.
+ struct RootMove {
+    move::Move move = 0;
+    // The nodes searched below the move in the current and the previous
+    // iteration.
+    uint64_t nodes = 0;
+    uint64_t previous_nodes = 0;
+    // The score of the move in the current and the previous iteration, or
+    // -kInfinity if the search only proved it is not the best move.
+    int score = -kInfinity;
+    int previous_score = -kInfinity;
+ };
+
+ // The result of searching one MultiPV line.
+ struct SearchLine {
+    PvLine pv_line;
+    int score = kUnknownScore;
+    int previous_score = kUnknownScore;
+ };
+
   uint64_t nodes = 0;
   int ply = 0;
   int score = kUnknownScore;
+  int previous_score_ = kUnknownScore;
+  int aspiration_researches_ = 0;
   
   move::Move killer_moves_[kMaxSearchDepth][kNumKillerMoves];
   int history_moves_[kPieceCount][kNumSquares];
   move::Move tt_move_ = 0;
+
+  // The best reply to a move, indexed by the piece and target square of the
+  // move being answered.
+  move::Move counter_moves_[kPieceCount][kNumSquares];
+
+  // Quiet move histories indexed by the move one ply back and two plies back.
+  ContinuationHistory continuation_history_[2];
+
+  // The move made at each ply of the current line. Null moves are stored as 0.
+  move::Move move_stack_[kMaxSearchDepth];
+
+  // Capture history indexed by the moving piece, the target square and the
+  // type of the captured piece.
+  int capture_history_[kPieceCount][kNumSquares][kPieceTypeCount];
+
+  // Search statistics, only collected when kCollectSearchStats is set. The
+  // snapshot taken at the start of the iteration and the node count of the
+  // previous iteration are used to report each iteration on its own.
+  SearchStats stats_;
+  SearchStats iteration_start_stats_;
+  uint64_t previous_iteration_nodes_ = 0;
+
+  // The hash tables of the evaluation of this search engine.
+  EvalTables eval_tables_;
   PvLine pv_line_;
 
+  // The number of principal variations to search, set by the MultiPV option.
+  int multi_pv_ = 1;
+
+  // The lines of the current search, best first, and the index of the line
+  // being searched.
+  std::vector<SearchLine> lines_;
+  int pv_index_ = 0;
+
+  // The moves searched at the root, in the order they are searched.
+  std::vector<RootMove> root_moves_;
+
+  // The moves the search is restricted to by go searchmoves. Empty to search
+  // all moves.
+  std::vector<move::Move> search_moves_;
+
+  // While a null move cutoff is being verified, null moves are disabled for
+  // the verifying side until this ply.
+  int null_move_min_ply_ = 0;
+  Color null_move_color_ = kWhite;
+
   // Search parameters
   int search_depth_ = -1;
   int current_depth_= -1;
@@ -38,12 +125,37 @@ class SearchEngine {
   int white_inc_ = 0;
   int black_inc_ = 0;
   int moves_to_go_ = 0;
+  int move_time_ = 0;
   bool engine_decides_search_params_ = false;
 
+  // Decides when to stop a timed search.
+  TimeManager time_manager_;
+
+  // Expires at end_time_ so the search does not have to read the clock.
+  StopTimer stop_timer_;
+
   bool stop_search_ = false;
   std::atomic<bool> &external_stop_;
 
-  SearchEngine(std::atomic<bool> &external_stop) : external_stop_(external_stop) {}
+  // Set while searching the expected position during the opponent's time.
+  // Cleared by the uci thread on ponderhit, which turns the search into a
+  // normal timed search without discarding anything it has found.
+  std::atomic<bool> pondering_{false};
+
+  // Whether the current search started as a ponder search that has not been
+  // hit yet.
+  bool ponder_search_ = false;
+
+  // Whether the time manager decides when the current search stops.
+  bool timed_search_ = false;
+
+  // Whether the search prints info lines and the best move. Turned off by the
+  // bench command.
+  bool print_info_ = true;
+
+  SearchEngine(std::atomic<bool> &external_stop) : external_stop_(external_stop) {
+    ClearHistory();
+  }
 
   // Starts the search.
   // @param position The position to search.
@@ -52,14 +164,63 @@ class SearchEngine {
   // Resets the search parameters.
   void ResetSearchParameters();
 
+  // Clears the move ordering histories. The histories persist between
+  // searches so this should only be called when starting a new game.
+  void ClearHistory();
+
+  // Fills root_moves_ with the legal moves of the position, restricted to
+  // search_moves_ if any of them are legal. The first iteration searches them
+  // in the normal move ordering.
+  // @param position The position to search.
+  void InitRootMoves(Position &position);
+
+  // Orders the root moves for the next iteration. The first moves of the
+  // lines come first in line order. The rest are ordered by their score in
+  // the last iteration if it was exact, and then by the nodes their subtrees
+  // needed, since a move that was hard to refute is the most likely to become
+  // best.
+  void SortRootMoves();
+
+  // Returns the root move for the given move.
+  // @param move The move.
+  // @return The root move, or nullptr if the move is not a root move.
+  RootMove *FindRootMove(move::Move move);
+
+  // Returns the percentage of the root nodes of the last iteration that were
+  // spent on the best move.
+  // @return The percentage.
+  int BestMoveNodeShare();
+
+  // Searches the line at pv_index_ for the current depth and stores the
+  // result in lines_.
+  // @param position The position to search.
+  void SearchCurrentLine(Position &position);
+
+  // Returns whether the given root move is the first move of a line before
+  // pv_index_ and must be skipped when searching the current line.
+  // @param move The root move.
+  // @return Whether the move is excluded.
+  bool IsExcludedRootMove(move::Move move) const;
+
+  // Searches the root at the current depth using an aspiration window around
+  // the score of the previous iteration. The window starts at
+  // kAspirationWindow plus half of the last score change and only the side
+  // that fails is widened, growing geometrically until the score fits.
+  // @param position The position to search.
+  // @param pv_line The PV line to fill.
+  // @return The score of the position.
+  int AspirationSearch(Position &position, PvLine *pv_line);
+
   // Negamax search
   // @param alpha The alpha value.
   // @param beta The beta value.
   // @param depth The depth to search.
   // @param position The position to search.
+  // @param node_type The expected type of the node.
   // @param is_null Whether the current node is a null move.
   // @return The score of the position.
-  int Negamax(int alpha, int beta, int depth, Position &position, PvLine *pv_line, bool is_null);
+  int Negamax(int alpha, int beta, int depth, Position &position,
+              PvLine *pv_line, NodeType node_type, bool is_null);
 
   // Quiescence search
   // @param alpha The alpha value.
@@ -75,12 +236,69 @@ class SearchEngine {
   // Checks to see if the search should stop.
   void CheckStop();
 
+  // Checks the stop conditions that can change in the middle of an iteration.
+  // Called at every node, so it only reads atomics and counters.
+  inline void PollStop();
+
   // Scores the given move for the given position.
   // @param move The move to score.
   // @param position The position to score the move for.
   // @return The score of the move.
   int ScoreMove(move::Move move, Position &position);
 
+  // Returns the move made the given number of plies before the current node.
+  // @param plies_back The number of plies to look back.
+  // @return The move, or 0 if there is no such move or it was a null move.
+  inline move::Move PreviousMove(int plies_back) const;
+
+  // Returns the combined history score of the given quiet move.
+  // @param move The quiet move.
+  // @return The history score of the move.
+  int QuietHistoryScore(move::Move move) const;
+
+  // Applies a bonus or penalty to all history tables for the given quiet move.
+  // @param move The quiet move.
+  // @param bonus The bonus to apply, negative for a penalty.
+  void UpdateQuietHistories(move::Move move, int bonus);
+
+  // Updates the killer moves, counter moves and histories after a quiet move
+  // caused a beta cutoff. Quiet moves searched before it are penalized.
+  // @param move The quiet move that caused the cutoff.
+  // @param depth The depth of the node.
+  // @param quiets_searched The quiet moves searched before the cutoff.
+  // @param num_quiets_searched The number of quiet moves searched.
+  void UpdateQuietCutoff(move::Move move, int depth,
+                         const move::Move *quiets_searched,
+                         int num_quiets_searched);
+
+  // Returns the capture history entry for the given capture.
+  // @param move The capture.
+  // @param position The position before the capture is made.
+  // @return The capture history entry.
+  inline int &CaptureHistory(move::Move move, const Position &position);
+
+  // Updates the capture histories after a beta cutoff. The cutoff move is
+  // rewarded if it is a capture and the captures searched before it are
+  // penalized.
+  // @param move The move that caused the cutoff.
+  // @param depth The depth of the node.
+  // @param position The position the moves were made from.
+  // @param captures_searched The captures searched before the cutoff.
+  // @param num_captures_searched The number of captures searched.
+  void UpdateCaptureCutoff(move::Move move, int depth, Position &position,
+                           const move::Move *captures_searched,
+                           int num_captures_searched);
+
+  // Copies the pawn hash table counters into the search statistics.
+  void CollectPawnHashStats();
+
+  // Prints the statistics of the iteration that just completed and starts
+  // counting the next one.
+  void PrintIterationStats();
+
+  // Prints the statistics of the whole last search.
+  void PrintStats();
+
   // Sorts the given moves for the given position.
   // @param moves The moves to sort.
   // @param position The position to sort the moves for.
@@ -92,9 +310,61 @@ class SearchEngine {
   // @return Whether we can perform LMR on the given move and position.
   bool CanDoLMR(move::Move move, Position &position);
 
-  // Prints the current search info.
-  void PrintSearchInfo(PvLine *pv_line, Position &position);
+  // Returns the move expected from the opponent after the best move. This is
+  // the second move of the PV, or the transposition table move if the PV is
+  // too short.
+  // @param position The position that was searched.
+  // @return The ponder move, or 0 if there is none.
+  move::Move GetPonderMove(Position &position);
+
+  // Prints the current search info for every line.
+  // @param position The position being searched.
+  void PrintSearchInfo(Position &position);
+
+  // Prints the current search info for one line.
+  // @param pv_line The PV line to print.
+  // @param line_score The score of the line.
+  // @param multipv The 1-based index of the line.
+  // @param position The position being searched.
+  void PrintSearchInfo(PvLine *pv_line, int line_score, int multipv,
+                       Position &position);
 };
+inline void SearchEngine::PollStop() {
+  // Start the clock as soon as a ponder search becomes a normal search
+  if (ponder_search_ && !pondering_.load(std::memory_order_relaxed)) {
+    CheckStop();
+  }
+  if (external_stop_.load(std::memory_order_relaxed) || stop_timer_.Expired() ||
+      (!ponder_search_ && max_nodes_ != 0 && nodes >= max_nodes_)) {
+    stop_search_ = true;
+  }
+}
+
+inline move::Move SearchEngine::PreviousMove(int plies_back) const {
+  return ply >= plies_back ? move_stack_[ply - plies_back] : 0;
+}
+
+inline int &SearchEngine::CaptureHistory(move::Move move,
+                                         const Position &position) {
+  Square target = move::GetTargetSquare(move);
+  PieceType captured_type = move::IsEnPassant(move)
+                                ? kPawn
+                                : GetPieceType(position.PieceOn(target));
+  return capture_history_[move::GetPiece(move)][target][captured_type];
+}
+
+// Captures are ordered by MVV-LVA plus their capture history divided by this.
+constexpr int kCaptureHistoryDivisor = 64;
+
+// Move ordering scores. Quiet moves are scored by their histories, which are
+// bounded by kMaxHistory per table and therefore stay below kPromotionScore.
+constexpr int kPvMoveScore = 1000000;
+constexpr int kTTMoveScore = 900000;
+constexpr int kCaptureScore = 100000;
+constexpr int kKillerMoveScore = 90000;
+constexpr int kCounterMoveScore = 85000;
+constexpr int kPromotionScore = 80000;
+
 // clang-format off
 constexpr int kMvvLvaScores[12][12] = {
   105, 205, 305, 405, 505, 605, 105, 205, 305, 405, 505, 605,
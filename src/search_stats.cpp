@@ -0,0 +1,71 @@
+#include "search_stats.hpp"
+
+#include <string>
+
+namespace chess {
+
+namespace {
+
+// Returns the given part of the total as a percentage.
+uint64_t Percent(uint64_t part, uint64_t total) {
+  return total == 0 ? 0 : (part * 100) / total;
+}
+
+}  // namespace
+
+SearchStats SearchStats::Since(const SearchStats &start) const {
+  SearchStats result = *this;
+  result.main_nodes -= start.main_nodes;
+  result.qsearch_nodes -= start.qsearch_nodes;
+  result.tt_probes -= start.tt_probes;
+  result.tt_hits -= start.tt_hits;
+  result.tt_cutoffs -= start.tt_cutoffs;
+  result.fail_highs -= start.fail_highs;
+  result.first_move_fail_highs -= start.first_move_fail_highs;
+  result.null_move_searches -= start.null_move_searches;
+  result.null_move_cutoffs -= start.null_move_cutoffs;
+  result.probcut_searches -= start.probcut_searches;
+  result.probcut_cutoffs -= start.probcut_cutoffs;
+  result.multicut_searches -= start.multicut_searches;
+  result.multicut_cutoffs -= start.multicut_cutoffs;
+  result.lmr_searches -= start.lmr_searches;
+  result.lmr_researches -= start.lmr_researches;
+  result.qsearch_cutoffs -= start.qsearch_cutoffs;
+  result.qsearch_first_move_cutoffs -= start.qsearch_first_move_cutoffs;
+  result.pawn_hash_probes -= start.pawn_hash_probes;
+  result.pawn_hash_hits -= start.pawn_hash_hits;
+  result.lazy_evals -= start.lazy_evals;
+  return result;
+}
+
+void SearchStats::Print(std::ostream &os, const std::string &label,
+                        uint64_t branching_factor) const {
+  uint64_t total_nodes = main_nodes + qsearch_nodes;
+  os << "info string stats " << label;
+  os << " seldepth " << seldepth;
+  os << " nodes " << total_nodes;
+  os << " qsearch " << Percent(qsearch_nodes, total_nodes) << "%";
+  os << " tt hits " << Percent(tt_hits, tt_probes) << "%";
+  os << " tt cutoffs " << Percent(tt_cutoffs, tt_probes) << "%";
+  os << " first move fail highs " << Percent(first_move_fail_highs, fail_highs)
+     << "%";
+  os << " null move cutoffs " << Percent(null_move_cutoffs, null_move_searches)
+     << "%";
+  os << " probcut cutoffs " << Percent(probcut_cutoffs, probcut_searches)
+     << "%";
+  os << " multicut cutoffs " << Percent(multicut_cutoffs, multicut_searches)
+     << "%";
+  os << " lmr researches " << Percent(lmr_researches, lmr_searches) << "%";
+  os << " qsearch cutoffs " << Percent(qsearch_cutoffs, qsearch_nodes) << "%";
+  os << " qsearch first move cutoffs "
+     << Percent(qsearch_first_move_cutoffs, qsearch_cutoffs) << "%";
+  os << " pawn hash hits " << Percent(pawn_hash_hits, pawn_hash_probes) << "%";
+  os << " lazy evals " << Percent(lazy_evals, qsearch_nodes) << "%";
+  if (branching_factor != 0) {
+    os << " ebf " << branching_factor / 100 << "."
+       << (branching_factor % 100 < 10 ? "0" : "") << branching_factor % 100;
+  }
+  os << std::endl;
+}
+
+}  // namespace chess
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef SEARCH_STATS_HPP
+#define SEARCH_STATS_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace chess {
+
+// Search statistics are only collected when the engine is built with
+// MAELLO_STATS defined (make STATS=1). Every update is guarded by
+// `if constexpr (kCollectSearchStats)` so a normal build does no extra work.
+#ifdef MAELLO_STATS
+inline constexpr bool kCollectSearchStats = true;
+#else
+inline constexpr bool kCollectSearchStats = false;
+#endif
+
+// Counters that describe how well the search and its move ordering work. Each
+// search engine has its own counters, so they are never shared between
+// threads.
+struct SearchStats {
+  uint64_t main_nodes = 0;
+  uint64_t qsearch_nodes = 0;
+
+  uint64_t tt_probes = 0;
+  uint64_t tt_hits = 0;
+  uint64_t tt_cutoffs = 0;
+
+  // Beta cutoffs in the main search, and how many of them were caused by the
+  // first move searched.
+  uint64_t fail_highs = 0;
+  uint64_t first_move_fail_highs = 0;
+
+  uint64_t null_move_searches = 0;
+  uint64_t null_move_cutoffs = 0;
+
+  // Captures searched by ProbCut and how many of them cut the node.
+  uint64_t probcut_searches = 0;
+  uint64_t probcut_cutoffs = 0;
+
+  // Nodes where multi-cut was tried and how many of them were cut.
+  uint64_t multicut_searches = 0;
+  uint64_t multicut_cutoffs = 0;
+
+  // Reduced searches and how many of them had to be searched again at full
+  // depth.
+  uint64_t lmr_searches = 0;
+  uint64_t lmr_researches = 0;
+
+  uint64_t qsearch_cutoffs = 0;
+  uint64_t qsearch_first_move_cutoffs = 0;
+
+  // Pawn hash table probes and how many of them found the pawn structure.
+  uint64_t pawn_hash_probes = 0;
+  uint64_t pawn_hash_hits = 0;
+
+  // Quiescence stand pat evaluations that returned the lazy estimate.
+  uint64_t lazy_evals = 0;
+
+  // The deepest ply reached, including the quiescence search.
+  int seldepth = 0;
+
+  // Resets all counters to 0.
+  inline void Clear();
+
+  // Returns the counters accumulated since the given snapshot was taken. The
+  // seldepth is not a counter and is kept as it is.
+  // @param start The snapshot.
+  // @return The difference between the counters.
+  SearchStats Since(const SearchStats &start) const;
+
+  // Prints the counters as an info string.
+  // @param os The stream to print to.
+  // @param label A word that describes the counters, such as "depth 7".
+  // @param branching_factor The effective branching factor times 100, or 0 if
+  // it is not known.
+  void Print(std::ostream &os, const std::string &label,
+             uint64_t branching_factor) const;
+};
+
+inline void SearchStats::Clear() { *this = SearchStats(); }
+
+}  // namespace chess
+
+#endif  // SEARCH_STATS_HPP
@@ -0,0 +1,53 @@
+#include "stop_timer.hpp"
+
+#include <chrono>
+
+namespace chess {
+
+StopTimer::StopTimer() : thread_(&StopTimer::Run, this) {}
+
+StopTimer::~StopTimer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  condition_.notify_one();
+  thread_.join();
+}
+
+void StopTimer::Arm(Time deadline) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    deadline_ = deadline;
+    expired_.store(false, std::memory_order_relaxed);
+  }
+  condition_.notify_one();
+}
+
+void StopTimer::Disarm() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    deadline_ = 0;
+    expired_.store(false, std::memory_order_relaxed);
+  }
+  condition_.notify_one();
+}
+
+void StopTimer::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!quit_) {
+    if (deadline_ == 0) {
+      condition_.wait(lock);
+    } else if (GetTime() >= deadline_) {
+      expired_.store(true, std::memory_order_relaxed);
+      deadline_ = 0;
+    } else {
+      // GetTime counts milliseconds on the steady clock
+      std::chrono::steady_clock::time_point wake_time(
+          std::chrono::milliseconds{deadline_});
+      condition_.wait_until(lock, wake_time);
+    }
+  }
+}
+
+}  // namespace chess
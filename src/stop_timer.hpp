@@ -0,0 +1,56 @@
+#pragma once
+#ifndef STOP_TIMER_HPP
+#define STOP_TIMER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "utils.hpp"
+
+namespace chess {
+
+// Sets a flag once a deadline has passed. The timer sleeps on its own thread,
+// so the search only has to read an atomic instead of reading the clock.
+class StopTimer {
+ public:
+  StopTimer();
+  ~StopTimer();
+
+  StopTimer(const StopTimer &) = delete;
+  StopTimer &operator=(const StopTimer &) = delete;
+
+  // Starts the timer, replacing any previous deadline.
+  // @param deadline The time at which the timer expires.
+  void Arm(Time deadline);
+
+  // Stops the timer without expiring it.
+  void Disarm();
+
+  // Returns whether the deadline has passed since the timer was last armed.
+  // @return Whether the timer has expired.
+  inline bool Expired() const;
+
+ private:
+  // Waits for deadlines until the timer is destroyed.
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+
+  // The current deadline, 0 if the timer is not armed. Guarded by mutex_.
+  Time deadline_ = 0;
+  bool quit_ = false;
+
+  std::atomic<bool> expired_{false};
+  std::thread thread_;
+};
+
+inline bool StopTimer::Expired() const {
+  return expired_.load(std::memory_order_relaxed);
+}
+
+}  // namespace chess
+
+#endif  // STOP_TIMER_HPP
@@ -0,0 +1,94 @@
+#include "time_manager.hpp"
+
+#include <algorithm>
+
+namespace chess {
+
+void TimeManager::Init(Time start_time, int time_remaining, int increment,
+                       int moves_to_go, int legal_moves) {
+  Restart(start_time);
+  fixed_time_ = false;
+  single_legal_move_ = legal_moves == 1;
+  last_iteration_time_ = 0;
+  last_best_move_ = 0;
+  last_score_ = kUnknownScore;
+  best_move_stability_ = 0;
+
+  // Spread the remaining time over the moves until the next time control,
+  // keeping the move overhead in reserve
+  int horizon = moves_to_go == 0 ? kDefaultMovesToGo
+                                 : std::min(moves_to_go, kDefaultMovesToGo);
+  int available = std::max(time_remaining - move_overhead_, 1);
+
+  int soft = available / horizon + (increment * 3) / 4;
+  int hard = std::min(soft * kHardLimitScale, (available * 3) / 4);
+  hard = std::max(hard, 1);
+  soft = std::min(soft, hard);
+
+  base_soft_limit_ = soft;
+  soft_limit_ = soft;
+  hard_limit_ = hard;
+}
+
+void TimeManager::InitFixed(Time start_time, int move_time) {
+  Restart(start_time);
+  fixed_time_ = true;
+  single_legal_move_ = false;
+  last_iteration_time_ = 0;
+  last_best_move_ = 0;
+  last_score_ = kUnknownScore;
+  best_move_stability_ = 0;
+
+  Time limit = std::max(move_time - move_overhead_, 1);
+  base_soft_limit_ = limit;
+  soft_limit_ = limit;
+  hard_limit_ = limit;
+}
+
+void TimeManager::Restart(Time start_time) {
+  start_time_ = start_time;
+  last_iteration_end_ = start_time;
+}
+
+void TimeManager::Update(Time now, move::Move best_move, int score,
+                         int best_move_node_share) {
+  last_iteration_time_ = now - last_iteration_end_;
+  last_iteration_end_ = now;
+
+  if (best_move == last_best_move_) {
+    best_move_stability_ =
+        std::min(best_move_stability_ + 1, kMaxBestMoveStability);
+  } else {
+    best_move_stability_ = 0;
+  }
+  int score_drop = 0;
+  if (last_score_ != kUnknownScore) {
+    score_drop = std::clamp(last_score_ - score, 0, kMaxScoreDrop);
+  }
+  last_best_move_ = best_move;
+  last_score_ = score;
+
+  if (fixed_time_) return;
+
+  // Spend more time when the best move is unstable, the score is falling or
+  // the other moves were hard to refute
+  Time scaled = base_soft_limit_ * kBestMoveStabilityScale[best_move_stability_];
+  scaled = (scaled * (kMaxScoreDrop + score_drop)) / (100 * kMaxScoreDrop);
+  best_move_node_share = std::clamp(best_move_node_share, 0, 100);
+  scaled = (scaled * (kNodeShareScale - best_move_node_share)) / 100;
+  soft_limit_ = std::min(scaled, hard_limit_);
+}
+
+bool TimeManager::ShouldStartIteration(Time now) const {
+  // One iteration is enough to find the only legal move
+  if (single_legal_move_) return false;
+
+  Time elapsed = now - start_time_;
+  if (elapsed >= soft_limit_) return false;
+
+  // Do not start an iteration that is expected to be cut off by the hard
+  // limit, since its result would most likely be thrown away
+  return elapsed + last_iteration_time_ * kIterationTimeGrowth <= hard_limit_;
+}
+
+}  // namespace chess
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef TIME_MANAGER_HPP
+#define TIME_MANAGER_HPP
+
+#include <cstdint>
+
+#include "utils.hpp"
+
+namespace chess {
+
+namespace move {
+using Move = uint32_t;
+}
+
+// Decides how long a search may run. The soft limit is the time the engine
+// aims to use and is adjusted after every iteration depending on how stable
+// the search is. The hard limit is the time the search must never exceed, even
+// in the middle of an iteration.
+class TimeManager {
+ public:
+  // The time in milliseconds to keep in reserve for each move to cover the
+  // communication delay between the engine and the server.
+  int move_overhead_ = kDefaultMoveOverhead;
+
+  Time start_time_ = 0;
+  Time soft_limit_ = 0;
+  Time hard_limit_ = 0;
+
+  // Sets the limits for a search that plays with the given clock.
+  // @param start_time The time the search started.
+  // @param time_remaining The time left on the clock in milliseconds.
+  // @param increment The increment per move in milliseconds.
+  // @param moves_to_go The moves until the next time control, 0 if unknown.
+  // @param legal_moves The number of legal moves in the position.
+  void Init(Time start_time, int time_remaining, int increment,
+            int moves_to_go, int legal_moves);
+
+  // Sets the limits for a search with a fixed time per move.
+  // @param start_time The time the search started.
+  // @param move_time The time to search in milliseconds.
+  void InitFixed(Time start_time, int move_time);
+
+  // Restarts the clock while keeping the limits. Used when a ponder search
+  // becomes a normal search.
+  // @param start_time The new start time.
+  void Restart(Time start_time);
+
+  // Updates the soft limit after an iteration has completed. The limit grows
+  // when the best move changes, when the score drops or when the other root
+  // moves needed many nodes to refute, and shrinks while the best move stays
+  // the same.
+  // @param now The current time.
+  // @param best_move The best move of the iteration.
+  // @param score The score of the iteration.
+  // @param best_move_node_share The percentage of the root nodes that were
+  // spent on the best move.
+  void Update(Time now, move::Move best_move, int score,
+              int best_move_node_share);
+
+  // Returns whether there is enough time to start another iteration. An
+  // iteration is not started once the soft limit has passed, or if it is
+  // expected to run past the hard limit and be thrown away.
+  // @param now The current time.
+  // @return Whether another iteration should be started.
+  bool ShouldStartIteration(Time now) const;
+
+  // Returns the time at which the search must stop.
+  // @return The hard deadline.
+  inline Time GetHardDeadline() const;
+
+ private:
+  bool fixed_time_ = false;
+  bool single_legal_move_ = false;
+
+  // The soft limit before stability adjustments, in milliseconds.
+  Time base_soft_limit_ = 0;
+
+  // The state of the previous iteration.
+  Time last_iteration_end_ = 0;
+  Time last_iteration_time_ = 0;
+  move::Move last_best_move_ = 0;
+  int last_score_ = kUnknownScore;
+  int best_move_stability_ = 0;
+};
+
+inline Time TimeManager::GetHardDeadline() const {
+  return start_time_ + hard_limit_;
+}
+
+// The hard limit is at most this many times the unadjusted soft limit.
+constexpr int kHardLimitScale = 5;
+
+// An iteration is expected to take at most this many times as long as the
+// previous one.
+constexpr int kIterationTimeGrowth = 2;
+
+// The soft limit scale in percent, indexed by the number of consecutive
+// iterations that returned the same best move.
+constexpr int kMaxBestMoveStability = 4;
+constexpr int kBestMoveStabilityScale[kMaxBestMoveStability + 1] = {
+    180, 130, 100, 80, 65};
+
+// A score drop between iterations increases the soft limit by the same
+// percentage, up to this many centipawns.
+constexpr int kMaxScoreDrop = 100;
+
+// The soft limit is scaled by this many percent minus the percentage of the
+// root nodes spent on the best move. A best move that takes most of the nodes
+// is rarely replaced.
+constexpr int kNodeShareScale = 160;
+
+}  // namespace chess
+
+#endif  // TIME_MANAGER_HPP
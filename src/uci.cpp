@@ -1,11 +1,17 @@
 #include "uci.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "batch_eval.hpp"
+#include "bench.hpp"
 #include "evaluator.hpp"
 #include "precomputed_data.hpp"
 
@@ -33,7 +39,7 @@ void Uci::Init() {
   }
   chess::precomputed_data::Init();
   chess::zobrist::Init();
-  InitEvalTables();
+  chess::cuckoo::Init();
   initialized_ = true;
 }
 
@@ -79,6 +85,9 @@ void Uci::ProcessCommand(const std::string &command) {
     std::cout << "id author " << "Matthew Bertello" << std::endl;
     std::cout << std::endl;
     std::cout << "option name Hash type spin default " << kDefaultTranspositionTableSize << " min 1 max 1024" << std::endl;
+    std::cout << "option name Ponder type check default false" << std::endl;
+    std::cout << "option name MultiPV type spin default 1 min 1 max " << kMaxMultiPv << std::endl;
+    std::cout << "option name Move Overhead type spin default " << kDefaultMoveOverhead << " min 0 max " << kMaxMoveOverhead << std::endl;
     std::cout << "uciok" << std::endl;
     Init();
   } else if (firstWord == "isready") {
@@ -97,24 +106,26 @@ void Uci::ProcessCommand(const std::string &command) {
     Init();
     StopSearchThread();
     ParseGo(remainingCommand);
+  } else if (firstWord == "ponderhit") {
+    search_engine_.pondering_ = false;
   } else if (firstWord == "setoption") {
     StopSearchThread();
     ParseOption(remainingCommand);
+  } else if (firstWord == "stats") {
+    StopSearchThread();
+    search_engine_.PrintStats();
   } else if (firstWord == "d") {
     StopSearchThread();
     std::cout << position_ << std::endl;
   } else if (firstWord == "perft") {
     Init();
     ParsePerft(remainingCommand);
+  } else if (firstWord == "bench") {
+    Init();
+    ParseBench(remainingCommand);
   } else if (firstWord == "eval") {
     Init();
-    int eval = Evaluate(position_);
-
-    if (position_.state_.side_to_move == kWhite) {
-      std::cout << eval << std::endl;
-    } else {
-      std::cout << -eval << std::endl;
-    }
+    ParseEval(remainingCommand);
   } else {
     std::cout << "Unknown command: " << command << std::endl;
   }
@@ -163,11 +174,288 @@ void Uci::ParsePerft(std::string command) {
   }
 }
 
+// bench [depth] [hash] [threads] [json] [compare]
+// With compare, the suite is searched a second time without the evaluation
+// cache to measure how much time the cache saves. Both runs search the same
+// nodes.
+void Uci::ParseBench(std::string command) {
+  StopSearchThread();
+
+  int depth = kDefaultBenchDepth;
+  int hash = kDefaultBenchHash;
+  int threads = 1;
+  bool json = false;
+  bool compare = false;
+
+  // The numbers are read in order, json and compare can be given anywhere
+  int numbers_read = 0;
+  while (command.length() > 0) {
+    std::string word = GetFirstWord(command);
+    command = RemoveFirstWord(command);
+
+    if (word == "json") {
+      json = true;
+      continue;
+    }
+    if (word == "compare") {
+      compare = true;
+      continue;
+    }
+    int value = 0;
+    try {
+      value = std::stoi(word);
+    } catch (const std::exception &e) {
+      std::cout << "Invalid bench parameter: " << word << std::endl;
+      return;
+    }
+    if (numbers_read == 0) {
+      depth = std::clamp(value, 1, kMaxSearchDepth);
+    } else if (numbers_read == 1) {
+      hash = std::clamp(value, 1, 1024);
+    } else if (numbers_read == 2) {
+      threads = value;
+    }
+    numbers_read++;
+  }
+
+  // The search is single threaded
+  if (threads != 1) {
+    std::cout << "info string bench uses 1 thread" << std::endl;
+    threads = 1;
+  }
+
+  // Every position starts from a clear state so the node count only depends
+  // on the build. The current position is restored afterwards.
+  PositionState saved_state = position_.GetState();
+  RepetitionTable saved_repetitions = position_.repetition_table_;
+  int previous_hash = position_.transposition_table_.size_;
+  int previous_multi_pv = search_engine_.multi_pv_;
+  position_.transposition_table_.ChangeSize(hash);
+  search_engine_.multi_pv_ = 1;
+  search_engine_.print_info_ = false;
+
+  EvalCache &eval_cache = search_engine_.eval_tables_.eval_cache;
+  uint64_t total_nodes = 0;
+  uint64_t total_time = 0;
+  uint64_t uncached_time = 0;
+  uint64_t eval_probes = 0;
+  uint64_t eval_hits = 0;
+  int num_positions = kBenchPositions.size();
+  for (int pass = 0; pass < (compare ? 2 : 1); pass++) {
+    bool cached = pass == 0;
+    eval_cache.enabled_ = cached;
+    for (int i = 0; i < num_positions; i++) {
+      Ucinewgame();
+      eval_cache.Clear();
+      ParsePosition("fen " + kBenchPositions[i]);
+      search_engine_.ResetSearchParameters();
+      search_engine_.search_depth_ = depth;
+      search_engine_.pondering_ = false;
+      stop_search_ = false;
+
+      uint64_t start = GetTimeMicroseconds();
+      search_engine_.Search(position_);
+      uint64_t time = GetTimeMicroseconds() - start;
+      if (!cached) {
+        uncached_time += time;
+        continue;
+      }
+      total_time += time;
+      total_nodes += search_engine_.nodes;
+      eval_probes += eval_cache.probes_;
+      eval_hits += eval_cache.hits_;
+
+      if (!json) {
+        std::cout << "Position " << (i + 1) << "/" << num_positions
+                  << " nodes " << search_engine_.nodes << " fen "
+                  << kBenchPositions[i] << std::endl;
+      }
+    }
+  }
+  eval_cache.enabled_ = true;
+
+  search_engine_.print_info_ = true;
+  search_engine_.multi_pv_ = previous_multi_pv;
+  position_.transposition_table_.ChangeSize(previous_hash);
+  search_engine_.ClearHistory();
+  position_.SetState(saved_state);
+  position_.repetition_table_ = saved_repetitions;
+
+  uint64_t time_ms = std::max<uint64_t>(total_time / 1000, 1);
+  uint64_t nps = (total_nodes * 1000000) / std::max<uint64_t>(total_time, 1);
+  uint64_t eval_hit_rate =
+      (eval_hits * 100) / std::max<uint64_t>(eval_probes, 1);
+  int64_t eval_time_saved =
+      (static_cast<int64_t>(uncached_time) - static_cast<int64_t>(total_time)) /
+      1000;
+  if (json) {
+    std::cout << "{\"depth\": " << depth << ", \"hash\": " << hash
+              << ", \"threads\": " << threads
+              << ", \"positions\": " << num_positions
+              << ", \"nodes\": " << total_nodes << ", \"time_ms\": " << time_ms
+              << ", \"nps\": " << nps
+              << ", \"eval_cache_hit_rate\": " << eval_hit_rate;
+    if (compare) {
+      std::cout << ", \"eval_cache_saved_ms\": " << eval_time_saved;
+    }
+    std::cout << "}" << std::endl;
+  } else {
+    std::cout << "Total time (ms): " << time_ms << std::endl;
+    std::cout << "Nodes searched: " << total_nodes << std::endl;
+    std::cout << "Nodes/second: " << nps << std::endl;
+    std::cout << "Eval cache hits: " << eval_hit_rate << "%" << std::endl;
+    if (compare) {
+      std::cout << "Eval cache saved (ms): " << eval_time_saved << std::endl;
+    }
+  }
+}
+
+// eval [trace [repetitions] | batch <file>]
+void Uci::ParseEval(std::string command) {
+  StopSearchThread();
+
+  if (GetFirstWord(command) == "batch") {
+    ParseEvalBatch(RemoveFirstWord(command));
+    return;
+  }
+
+  if (GetFirstWord(command) != "trace") {
+    int eval = Evaluate(position_);
+    if (position_.state_.side_to_move == kWhite) {
+      std::cout << eval << std::endl;
+    } else {
+      std::cout << -eval << std::endl;
+    }
+    return;
+  }
+
+  command = RemoveFirstWord(command);
+  int repetitions = kDefaultEvalTraceRepetitions;
+  if (GetFirstWord(command) != "") {
+    try {
+      repetitions = std::max(std::stoi(GetFirstWord(command)), 1);
+    } catch (const std::exception &e) {
+      std::cout << "Invalid repetitions" << std::endl;
+      return;
+    }
+  }
+
+  EvalTrace trace;
+  TraceEvaluation(position_, trace);
+
+  // Prints a score as its middlegame and endgame values
+  auto print_score = [](Score score) {
+    std::cout << std::setw(7) << MgValue(score) << std::setw(6)
+              << EgValue(score) << " ";
+  };
+  std::cout << "        Term |    White     |    Black     |    Total\n"
+            << "             |     MG    EG |     MG    EG |     MG    EG\n"
+            << " ------------+--------------+--------------+--------------\n";
+  Score total = kScoreZero;
+  for (int term = 0; term < kNumEvalTerms; term++) {
+    Score white = trace.terms[term][kWhite];
+    Score black = trace.terms[term][kBlack];
+    total += white - black;
+    std::cout << std::setw(12) << kEvalTermNames[term] << " |";
+    print_score(white);
+    std::cout << "|";
+    print_score(black);
+    std::cout << "|";
+    print_score(white - black);
+    std::cout << "\n";
+  }
+  std::cout << " ------------+--------------+--------------+--------------\n"
+            << std::setw(12) << "Total"
+            << " |              |              |";
+  print_score(total);
+  std::cout << "\n\n";
+
+  std::cout << "Game phase: " << trace.game_phase << "/24" << std::endl;
+  std::cout << "Scale factors: white " << trace.scale_factors[kWhite]
+            << ", black " << trace.scale_factors[kBlack] << " (of "
+            << kNormalScaleFactor << ")" << std::endl;
+  if (trace.known_endgame) {
+    std::cout << "Known endgame, scored without the terms" << std::endl;
+  }
+  std::cout << "Evaluation: " << trace.score << " (white side)" << std::endl;
+
+  // Times the full evaluation without any hash tables, so every term is
+  // computed on every repetition
+  int sum = 0;
+  uint64_t start = GetTimeMicroseconds();
+  for (int i = 0; i < repetitions; i++) {
+    sum += Evaluate(position_);
+  }
+  uint64_t time = std::max<uint64_t>(GetTimeMicroseconds() - start, 1);
+  volatile int sink = sum;
+  (void)sink;
+  std::cout << "Evals/second: "
+            << (static_cast<uint64_t>(repetitions) * 1000000) / time << " ("
+            << repetitions << " evaluations in " << time << " us)"
+            << std::endl;
+}
+
+// eval batch <file>
+void Uci::ParseEvalBatch(std::string command) {
+  std::string file_name = GetFirstWord(command);
+  std::ifstream file(file_name);
+  if (!file) {
+    std::cout << "Cannot open " << file_name << std::endl;
+    return;
+  }
+
+  // Read one FEN per line. The position is only used to parse the FENs, so
+  // its state and repetition history are restored afterwards.
+  PositionState saved_state = position_.GetState();
+  RepetitionTable saved_repetitions = position_.repetition_table_;
+  std::vector<PackedPosition> positions;
+  std::string fen;
+  bool valid = true;
+  while (std::getline(file, fen)) {
+    if (fen.empty()) continue;
+    try {
+      position_.Set(fen);
+    } catch (const std::exception &e) {
+      std::cout << "Invalid FEN: " << fen << std::endl;
+      valid = false;
+      break;
+    }
+    positions.push_back(PackPosition(position_));
+  }
+  position_.SetState(saved_state);
+  position_.repetition_table_ = saved_repetitions;
+  if (!valid) return;
+
+  std::vector<int> scores(positions.size());
+  if (!batch_evaluator_) {
+    batch_evaluator_ = std::make_unique<BatchEvaluator>(
+        std::max<int>(std::thread::hardware_concurrency(), 1));
+  }
+  uint64_t start = GetTimeMicroseconds();
+  batch_evaluator_->Evaluate(positions.data(), positions.size(),
+                             scores.data());
+  uint64_t time = std::max<uint64_t>(GetTimeMicroseconds() - start, 1);
+
+  // Scores are printed from white's point of view like the eval command
+  std::ostringstream output;
+  for (size_t i = 0; i < positions.size(); i++) {
+    output << (positions[i].side_to_move == kWhite ? scores[i] : -scores[i])
+           << "\n";
+  }
+  std::cout << output.str();
+  std::cout << "info string evaluated " << positions.size() << " positions in "
+            << time << " us with " << batch_evaluator_->GetThreadCount()
+            << " threads, " << (positions.size() * 1000000) / time
+            << " evals/second"
+            << std::endl;
+}
+
 void Uci::Ucinewgame() {
   StopSearchThread();
   position_.Reset();
   position_.transposition_table_.Clear();
   position_.repetition_table_.Clear();
+  search_engine_.ClearHistory();
 }
 
 void Uci::ParseGo(std::string command) {
@@ -182,6 +470,7 @@ void Uci::ParseGo(std::string command) {
   uint64_t nodes = 0;
   uint64_t moveTime = 0;
   bool infinite = false;
+  bool ponder = false;
 
   std::string firstWord;
 
@@ -219,6 +508,16 @@ void Uci::ParseGo(std::string command) {
       command = RemoveFirstWord(command);
     } else if (firstWord == "infinite") {
       infinite = true;
+    } else if (firstWord == "ponder") {
+      ponder = true;
+    } else if (firstWord == "searchmoves") {
+      // The moves end at the first word that is not a move
+      while (command.length() > 0) {
+        move::Move move = ParseMove(GetFirstWord(command));
+        if (move == 0) break;
+        search_engine_.search_moves_.push_back(move);
+        command = RemoveFirstWord(command);
+      }
     }
   }
 
@@ -230,7 +529,7 @@ void Uci::ParseGo(std::string command) {
       search_engine_.max_nodes_ = nodes;
     }
     if (moveTime != 0) {
-      search_engine_.end_time_ = GetTime() + moveTime;
+      search_engine_.move_time_ = moveTime;
     } else {
       if (movesToGo != 0) {
         search_engine_.moves_to_go_ = movesToGo;
@@ -251,6 +550,7 @@ void Uci::ParseGo(std::string command) {
     }
   }
 
+  search_engine_.pondering_ = ponder;
   stop_search_ = false;
   search_thread_ = std::thread(&Uci::SearchThreadFunction, this);
 }
@@ -262,18 +562,26 @@ void Uci::ParseOption(std::string command) {
   // remove the first word from the command
   command = RemoveFirstWord(command);
 
-  if (firstWord == "name") {
-    std::string name = GetFirstWord(command);
+  if (firstWord != "name") return;
+
+  // Option names can contain spaces so read words until "value"
+  std::string name = "";
+  while (command.length() > 0 && GetFirstWord(command) != "value") {
+    if (!name.empty()) name += " ";
+    name += GetFirstWord(command);
     command = RemoveFirstWord(command);
-    if (name == "Hash") {
-      std::string value = GetFirstWord(command);
-      command = RemoveFirstWord(command);
-      if (value == "value") {
-        std::string size = GetFirstWord(command);
-        command = RemoveFirstWord(command);
-        position_.transposition_table_.ChangeSize(std::stoi(size));
-      }
-    }
+  }
+  command = RemoveFirstWord(command);
+  std::string value = GetFirstWord(command);
+  if (value.empty()) return;
+
+  if (name == "Hash") {
+    position_.transposition_table_.ChangeSize(std::stoi(value));
+  } else if (name == "MultiPV") {
+    search_engine_.multi_pv_ = std::clamp(std::stoi(value), 1, kMaxMultiPv);
+  } else if (name == "Move Overhead") {
+    search_engine_.time_manager_.move_overhead_ =
+        std::clamp(std::stoi(value), 0, kMaxMoveOverhead);
   }
 }
 
@@ -324,8 +632,10 @@ void Uci::ParsePosition(std::string command) {
         if (move == 0) {
           break;
         }
-        position_.MakeMove(move, false);
+        // The table holds the positions before the current one, as it does
+        // during the search
         position_.repetition_table_.Add(position_.state_.key);
+        position_.MakeMove(move, false);
       }
     }
   }
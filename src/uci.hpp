@@ -1,8 +1,10 @@
 #pragma once
 #include <atomic>
 #include <iostream>
+#include <memory>
 #include <thread>
 
+#include "batch_eval.hpp"
 #include "search.hpp"
 namespace chess {
 
@@ -25,6 +27,10 @@ class Uci {
   SearchEngine search_engine_ = SearchEngine(stop_search_);
   Position position_;
   bool uses_Ucinewgame_ = false;
+
+  // The threads that evaluate eval batch commands, one per core. Started by
+  // the first batch and reused by the later ones.
+  std::unique_ptr<BatchEvaluator> batch_evaluator_;
   bool initialized_ = false;
 
   // Returns the first word of the given string
@@ -55,6 +61,26 @@ class Uci {
   // @param command The command to parse
   void ParsePerft(std::string command);
 
+  // Parses the bench command and searches the bench positions. Prints the
+  // total node count, which is the same on every run of the same build, and
+  // the speed of the search. The current position is kept, but the
+  // transposition table and the history tables are cleared.
+  // @param command The command to parse
+  void ParseBench(std::string command);
+
+  // Parses the eval command. Prints the evaluation of the current position
+  // from white's point of view. With trace, prints the evaluation broken down
+  // by term and side, and how many evaluations per second the position takes.
+  // With batch, evaluates the positions of a file.
+  // @param command The command to parse
+  void ParseEval(std::string command);
+
+  // Parses the eval batch command. Evaluates every FEN in the given file, one
+  // per line, and prints their evaluations from white's point of view in the
+  // same order, followed by the evaluation speed.
+  // @param command The command to parse
+  void ParseEvalBatch(std::string command);
+
   // Command to tell the engine that the next position is from a new game.
   // Resets the search.
   void Ucinewgame();
@@ -13,40 +13,93 @@ namespace chess {
 // User Configurable Parameters
 /******************************************************************************/
 inline uint32_t randomState = 1804289383;
-
-// If there are <= this many non pawn or king pieces, then we are in the endgame
-inline constexpr int kEndgamePieceCount = 6;
+inline uint64_t randomKeyState = 0x9E3779B97F4A7C15;
 
 // The maximum search depth in plies.
 inline constexpr int kMaxSearchDepth = 128;
 
-// The amount of time that the engine tries to keep on the clock. This is
-// helpful to prevent the engine from flagging. As the remaining time approaches
-// this value, the engine will start moving more quickly. If the remaining time
-// is less than this value, the engine will attempt to move instantly.
-inline constexpr int kTimeBuffer = 1000;
+// The default time in milliseconds that is kept in reserve for each move to
+// cover the delay between the engine and the server. Set by the Move Overhead
+// option.
+inline constexpr int kDefaultMoveOverhead = 50;
+inline constexpr int kMaxMoveOverhead = 5000;
 
 // If the moves to go is not specified then the engine will assume that it will
-// need to make this many more moves in the time control
-inline constexpr int kDefaultMovesToGo = 60;
+// need to make this many more moves in the time control. This is also the
+// largest number of moves the remaining time is divided over.
+inline constexpr int kDefaultMovesToGo = 40;
 
 // The number of killer moves to store.
 inline constexpr int kNumKillerMoves = 2;
 
-// The size of the repetition table in entries. We only need to check the last
-// 100 plies when checking for a draw but this table is larger because it needs
-// to store extra values during the search.
-inline constexpr int kRepetitionTableSize = 100 + kMaxSearchDepth;
+// The maximum absolute value of a history table entry. History updates use a
+// gravity formula so entries saturate at this value instead of growing without
+// bound.
+inline constexpr int kMaxHistory = 16384;
+
+// The largest bonus or penalty that a single history update can apply.
+inline constexpr int kMaxHistoryBonus = 1536;
+
+// The maximum number of quiet moves per node that are remembered so they can
+// be penalized when a later move causes a beta cutoff.
+inline constexpr int kMaxQuietsSearched = 64;
+
+// The maximum number of captures per node that are remembered so they can be
+// penalized in the capture history when a later move causes a beta cutoff.
+inline constexpr int kMaxCapturesSearched = 32;
+
+// The number of keys the repetition table reserves space for. It holds the
+// whole game plus the search path and grows if a game is longer than this.
+inline constexpr int kRepetitionTableSize = 512 + kMaxSearchDepth;
+
+// The number of key bits used to index the repetition table filter.
+inline constexpr int kRepetitionFilterBits = 12;
+
+// The number of entries in the pawn hash table. Must be a power of 2.
+inline constexpr int kPawnHashTableSize = 16384;
+
+// The number of entries in the material hash table. Must be a power of 2.
+inline constexpr int kMaterialHashTableSize = 8192;
+
+// The number of entries in the evaluation cache. Must be a power of 2.
+inline constexpr int kEvalCacheSize = 65536;
+
+// The maximum number of principal variations the MultiPV option allows.
+inline constexpr int kMaxMultiPv = 256;
 
 // The size of the transposition table in megabytes
 inline constexpr int kDefaultTranspositionTableSize = 128;
 
-// The search will checkup every kCheckupFrequency nodes to see if it should
-// stop.
-inline constexpr int kCheckupFrequency = 2048;
-
-// How much to reduce the search depth by when doing a null move.
-inline constexpr int kNullMoveReductionAmount = 2;
+// Null move pruning is only tried at this depth or above.
+inline constexpr int kNullMoveMinDepth = 3;
+
+// The null move search depth is reduced by kNullMoveBaseReduction, plus one
+// for every kNullMoveDepthDivisor plies of depth, plus one for every
+// kNullMoveEvalMargin centipawns the static eval is above beta, up to
+// kNullMoveMaxEvalReduction.
+inline constexpr int kNullMoveBaseReduction = 2;
+inline constexpr int kNullMoveDepthDivisor = 4;
+inline constexpr int kNullMoveEvalMargin = 200;
+inline constexpr int kNullMoveMaxEvalReduction = 2;
+
+// Null move cutoffs at this depth or above are verified with a reduced search
+// of the node itself.
+inline constexpr int kNullMoveVerificationDepth = 8;
+
+// ProbCut is tried at this depth or above. A capture cuts the node if it
+// beats beta + kProbCutMargin in a search reduced by kProbCutDepthReduction.
+inline constexpr int kProbCutMinDepth = 5;
+inline constexpr int kProbCutMargin = 200;
+inline constexpr int kProbCutDepthReduction = 4;
+
+// Multi-cut is tried at expected cut nodes at this depth or above. The first
+// kMultiCutMoves moves are searched with the depth reduced by
+// kMultiCutReduction, and the node is cut once kMultiCutRequired of them beat
+// beta.
+inline constexpr int kMultiCutMinDepth = 7;
+inline constexpr int kMultiCutMoves = 6;
+inline constexpr int kMultiCutRequired = 3;
+inline constexpr int kMultiCutReduction = 3;
 
 // The minimum number of full depth searches to complete at each ply.
 inline constexpr int kMinimumFullDepthSearches = 2;
@@ -60,8 +113,13 @@ inline constexpr int kLmrReductionLimit = 3;
 // The amount to reduce the search depth by when using LMR.
 inline constexpr int kLmrReductionAmount = 1;
 
-// The aspiration window size.
-inline constexpr int kAspirationWindow = 50;
+// The initial aspiration window size. The window grows by half of the score
+// change in the previous iteration and widens geometrically on each fail.
+inline constexpr int kAspirationWindow = 25;
+
+// Aspiration windows are only used from this depth onwards. Shallower
+// iterations are cheap and their scores too unstable to centre a window on.
+inline constexpr int kAspirationMinDepth = 4;
 
 // A value that represents an unknown score.
 inline constexpr int kUnknownScore = 100000;
@@ -86,6 +144,11 @@ using Time = uint64_t;
 
 // Enums
 /******************************************************************************/
+// A middlegame and an endgame score packed into one integer, so a term that
+// scores both phases takes a single addition. The endgame score is in the
+// upper 16 bits and the middlegame score in the lower 16 bits.
+enum Score : int { kScoreZero = 0 };
+
 enum Color : int {
   kWhite = 0,
   kBlack = 1,
@@ -326,6 +389,12 @@ ENABLE_ALL_OPERATORS_ON(Piece);
 ENABLE_ALL_OPERATORS_ON(Square);
 ENABLE_ALL_OPERATORS_ON(File);
 ENABLE_ALL_OPERATORS_ON(Rank);
+ENABLE_BASE_OPERATORS_ON(Score);
+
+// A score is multiplied by an integer as a whole, the carry from the
+// middlegame half into the endgame half is undone by EgValue.
+constexpr Score operator*(Score s, int i) { return Score(int(s) * i); }
+constexpr Score operator*(int i, Score s) { return Score(i * int(s)); }
 
 #undef ENABLE_BASE_OPERATORS_ON
 #undef ENABLE_INCR_OPERATORS_ON
@@ -435,6 +504,90 @@ constexpr inline Square GetSquare(File file, Rank rank) {
   return Square(((7 - rank) << 3) | file);
 }
 
+// Moves every bit of a bitboard one file to the east. Bits on the h file are
+// dropped.
+// @param b The bitboard
+// @return The shifted bitboard
+constexpr inline Bitboard ShiftEast(Bitboard b) {
+  return (b & ~kHFileMask) << kEast;
+}
+
+// Moves every bit of a bitboard one file to the west. Bits on the a file are
+// dropped.
+// @param b The bitboard
+// @return The shifted bitboard
+constexpr inline Bitboard ShiftWest(Bitboard b) {
+  return (b & ~kAFileMask) >> -kWest;
+}
+
+// Fills every bit of a bitboard towards the eighth rank
+// @param b The bitboard
+// @return The bitboard with every square north of a set bit set
+constexpr inline Bitboard NorthFill(Bitboard b) {
+  b |= b >> 8;
+  b |= b >> 16;
+  b |= b >> 32;
+  return b;
+}
+
+// Fills every bit of a bitboard towards the first rank
+// @param b The bitboard
+// @return The bitboard with every square south of a set bit set
+constexpr inline Bitboard SouthFill(Bitboard b) {
+  b |= b << 8;
+  b |= b << 16;
+  b |= b << 32;
+  return b;
+}
+
+// Fills every bit of a bitboard along its whole file
+// @param b The bitboard
+// @return The bitboard with every file that has a set bit set
+constexpr inline Bitboard FileFill(Bitboard b) {
+  return NorthFill(b) | SouthFill(b);
+}
+
+// Returns the squares in front of the given pieces, from the point of view of
+// the given color
+// @param b The pieces
+// @param c The color the pieces move towards the opponent for
+// @return The squares strictly in front of the pieces on their files
+constexpr inline Bitboard FrontSpan(Bitboard b, Color c) {
+  return c == kWhite ? NorthFill(b) >> 8 : SouthFill(b) << 8;
+}
+
+// Returns the squares behind the given pieces, from the point of view of the
+// given color
+// @param b The pieces
+// @param c The color the pieces move towards the opponent for
+// @return The squares strictly behind the pieces on their files
+constexpr inline Bitboard RearSpan(Bitboard b, Color c) {
+  return FrontSpan(b, ~c);
+}
+
+// Packs a middlegame and an endgame score into a score.
+// @param mg The middlegame score.
+// @param eg The endgame score.
+// @return The packed score.
+constexpr inline Score MakeScore(int mg, int eg) {
+  return Score(int(static_cast<unsigned int>(eg) << 16) + mg);
+}
+
+// Gets the middlegame part of a score.
+// @param s The score.
+// @return The middlegame score.
+constexpr inline int MgValue(Score s) {
+  return static_cast<int16_t>(static_cast<uint16_t>(static_cast<unsigned>(s)));
+}
+
+// Gets the endgame part of a score.
+// @param s The score.
+// @return The endgame score.
+constexpr inline int EgValue(Score s) {
+  return static_cast<int16_t>(
+      static_cast<uint16_t>(static_cast<unsigned>(s + 0x8000) >> 16));
+}
+
 // Get a psuedo-random 32-bit number
 // @return A psuedo-random 32-bit number
 inline uint32_t GetRandomNumber32() {
@@ -444,6 +597,18 @@ inline uint32_t GetRandomNumber32() {
   return randomState;
 }
 
+// Get a psuedo-random 64-bit hash key. Every output of the xorshift generator
+// is a linear function of its 32-bit state, so keys built from it can cancel
+// each other out when XORed together. The splitmix64 generator used here mixes
+// with multiplications, so XORs of its keys collide no more often than random.
+// @return A psuedo-random 64-bit hash key
+inline uint64_t GetRandomKey() {
+  uint64_t z = (randomKeyState += 0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
 // Get a psuedo-random 64-bit number
 // @return A psuedo-random 64-bit number
 inline uint64_t GetRandomNumber64() {
@@ -455,10 +620,18 @@ inline uint64_t GetRandomNumber64() {
   return n1 | (n2 << 16) | (n3 << 32) | (n4 << 48);
 }
 
-// Gets the current time in milliseconds
+// Gets the current time in milliseconds. The steady clock is used so that
+// adjustments to the system clock do not affect the search time.
 inline uint64_t GetTime() {
   return std::chrono::duration_cast<std::chrono::milliseconds>(
-             std::chrono::system_clock::now().time_since_epoch())
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Gets the current time in microseconds on the same clock as GetTime.
+inline uint64_t GetTimeMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
       .count();
 }
 